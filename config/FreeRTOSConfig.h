@@ -59,6 +59,8 @@
 #define configUSE_COUNTING_SEMAPHORES           1
 #define configQUEUE_REGISTRY_SIZE               8
 #define configUSE_QUEUE_SETS                    1
+// Index 1 wakes the task waiting for an I2C transaction of the TKJHAT bus service, index 0 is for the application
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   2
 #define configUSE_TIME_SLICING                  1
 #define configUSE_NEWLIB_REENTRANT              0
 // todo need this for lwip FreeRTOS sys_arch to compile
@@ -208,6 +208,63 @@ SOFTWARE.
 #define ICM42670_GYRO_MODE_LN                   0x0C
 #define ICM42670_SENSOR_DATA_START_REG          0x09
 
+// FIFO registers (bank 0)
+#define ICM42670_FIFO_CONFIG1_REG               0x28
+#define ICM42670_FIFO_CONFIG2_REG               0x29    // FIFO_WM[7:0]
+#define ICM42670_FIFO_CONFIG3_REG               0x2A    // FIFO_WM[11:8]
+#define ICM42670_INT_SOURCE0_REG                0x2B
+#define ICM42670_INTF_CONFIG0_REG               0x35
+#define ICM42670_INT_STATUS_REG                 0x3A
+#define ICM42670_FIFO_COUNTH_REG                0x3D
+#define ICM42670_FIFO_DATA_REG                  0x3F
+
+// Indirect access to the MREG1 bank
+#define ICM42670_BLK_SEL_W_REG                  0x79
+#define ICM42670_MADDR_W_REG                    0x7A
+#define ICM42670_M_W_REG                        0x7B
+#define ICM42670_MREG1_FIFO_CONFIG5             0x01
+
+// Wake-on-motion (WOM) registers
+#define ICM42670_WOM_CONFIG_REG                 0x27
+#define ICM42670_INT_SOURCE1_REG                0x2C
+#define ICM42670_INT_STATUS2_REG                0x3B    // WOM status, cleared on read
+#define ICM42670_MREG1_ACCEL_WOM_X_THR          0x4B
+#define ICM42670_MREG1_ACCEL_WOM_Y_THR          0x4C
+#define ICM42670_MREG1_ACCEL_WOM_Z_THR          0x4D
+
+// WOM bit fields
+#define ICM42670_WOM_EN                         0x01    // WOM_CONFIG
+#define ICM42670_WOM_MODE_PREVIOUS              0x02    // WOM_CONFIG, compare with the previous sample
+#define ICM42670_WOM_XYZ_INT1_EN                0x07    // INT_SOURCE1, X, Y and Z
+#define ICM42670_WOM_XYZ_INT                    0x07    // INT_STATUS2
+#define ICM42670_WOM_MG_PER_LSB_X100            391     // threshold step: 1 g / 256
+#define ICM42670_ACCEL_LP_GYRO_OFF              0x02    // PWR_MGMT0
+
+// FIFO bit fields
+#define ICM42670_FIFO_BYPASS                    0x01    // FIFO_CONFIG1
+#define ICM42670_FIFO_FLUSH                     0x04    // SIGNAL_PATH_RESET
+#define ICM42670_FIFO_COUNT_RECORDS             0x40    // INTF_CONFIG0, count in packets instead of bytes
+#define ICM42670_DRDY_INT1_EN                   0x08    // INT_SOURCE0
+#define ICM42670_FIFO_THS_INT1_EN               0x04    // INT_SOURCE0
+#define ICM42670_FIFO_THS_INT                   0x04    // INT_STATUS
+#define ICM42670_FIFO_FULL_INT                  0x02    // INT_STATUS
+#define ICM42670_FIFO_ACCEL_EN                  0x01    // FIFO_CONFIG5
+#define ICM42670_FIFO_GYRO_EN                   0x02    // FIFO_CONFIG5
+
+// FIFO packet 3: header, accel, gyro, temperature and timestamp
+#define ICM42670_FIFO_PACKET_SIZE               16
+#define ICM42670_FIFO_HEADER_EMPTY              0x80
+#define ICM42670_FIFO_HEADER_ACCEL              0x40
+#define ICM42670_FIFO_HEADER_GYRO               0x20
+#define ICM42670_FIFO_MAX_BURST                 32      // packets drained by one I2C transaction
+#define ICM42670_FIFO_TEMP_LSB_PER_C            2       // FIFO temperature: °C = value / 2 + 25
+
+// Startup calibration
+#define ICM42670_CALIB_MAX_SAMPLES              1024
+#define ICM42670_CALIB_MAX_GYRO_SPAN_DPS        3       // larger gyro spread while averaging -> the board moved
+#define ICM42670_CALIB_MAX_ACCEL_SPAN_MG        50      // larger accel spread while averaging -> the board moved
+#define ICM42670_CALIB_TC_MIN_DELTA             8       // FIFO counts (4 °C) between 2 calibrations to learn the gyro drift
+
 /* =========================
  *  Public function prototypes
  * ========================= */
@@ -384,33 +441,128 @@ void stop_rgb_led(void);
  *  BUZZER
  * ========================= */
 
+/** Number of notes that can wait in the buzzer queue (tones and sequences together). */
+#define BUZZER_QUEUE_LENGTH                     64
+
+/**
+ * @brief One note of a buzzer sequence.
+ *
+ * A frequency of 0 is a rest: the buzzer stays silent for the duration.
+ */
+typedef struct {
+    uint16_t frequency;   ///< Tone frequency in Hz (0 = rest).
+    uint16_t duration_ms; ///< Duration of the note in milliseconds.
+} buzzer_note_t;
+
+/**
+ * @brief Callback called when a queued tone or sequence has finished.
+ *
+ * @note It runs in the timer interrupt: keep it short and only use
+ *       interrupt-safe calls (e.g. FreeRTOS `...FromISR` functions).
+ */
+typedef void (*buzzer_done_callback_t)(void *user_data);
+
 /**
  * @brief Initialize the buzzer (GPIO 17).
  *
- * Configures the buzzer pin as a digital output.  
- * After this call, the buzzer can be controlled with
- * ::buzzer_play_tone() or ::buzzer_turn_off().
+ * Configures the buzzer pin as a PWM output (slice 0, channel B) that
+ * is silent until a tone is played. After this call, the buzzer can be
+ * controlled with ::buzzer_play_tone_async(), ::buzzer_play_sequence_async(),
+ * ::buzzer_set_tone(), ::buzzer_play_tone() or ::buzzer_turn_off().
  */
 void init_buzzer(void);
 
 /**
  * @brief Play a tone on the buzzer.
  *
- * Generates a square wave at the requested frequency for the
- * specified duration by toggling the buzzer pin.
+ * Generates a square wave at the requested frequency with the PWM
+ * for the specified duration, then silences the buzzer.
  *
  * @param frequency     Tone frequency in Hz.
  * @param duration_ms   Duration of the tone in milliseconds.
  *
- * @note This implementation is blocking: the CPU is kept busy
- *       toggling the pin for the entire duration.
+ * @note This function still returns only after the tone, but it waits
+ *       with `sleep_ms()` (a FreeRTOS task delay when FreeRTOS is used)
+ *       instead of keeping the CPU busy. Prefer ::buzzer_play_tone_async().
  */
 void buzzer_play_tone(uint32_t frequency, uint32_t duration_ms);
 
+/**
+ * @brief Queue a tone and return immediately.
+ *
+ * The tone starts when the notes queued before it are finished. The PWM
+ * generates the sound and a timer alarm ends it, so no CPU time is used
+ * while it plays.
+ *
+ * @param frequency     Tone frequency in Hz (0 = silence).
+ * @param duration_ms   Duration of the tone in milliseconds.
+ * @param done          Called when the tone has finished (may be NULL).
+ * @param user_data     Passed to @p done.
+ * @return true if the tone was queued, false if the queue is full
+ *         (or no timer alarm was free to start it).
+ */
+bool buzzer_play_tone_async(uint32_t frequency, uint32_t duration_ms,
+                            buzzer_done_callback_t done, void *user_data);
+
+/**
+ * @brief Queue a sequence of notes (e.g. a melody) and return immediately.
+ *
+ * The notes are copied, so @p notes can be a local array.
+ *
+ * @param notes     Notes to play in order.
+ * @param count     Number of notes.
+ * @param done      Called when the last note has finished (may be NULL).
+ * @param user_data Passed to @p done.
+ * @return true if all notes were queued, false (nothing queued) if they do not fit.
+ */
+bool buzzer_play_sequence_async(const buzzer_note_t *notes, size_t count,
+                                buzzer_done_callback_t done, void *user_data);
+
+/**
+ * @brief Start or stop a tone right now, without a duration.
+ *
+ * For callers that do their own timing (e.g. from a timer interrupt).
+ * Safe to call from an interrupt. Claim the buzzer first with
+ * ::buzzer_claim() so the queued notes do not change the tone meanwhile.
+ *
+ * @param frequency Tone frequency in Hz, 0 silences the buzzer.
+ */
+void buzzer_set_tone(uint32_t frequency);
+
+/**
+ * @brief Take the buzzer for ::buzzer_set_tone().
+ *
+ * The playing queued note is cut and the queue waits: notes queued
+ * meanwhile are accepted but do not play. The cut note plays again
+ * from its start after ::buzzer_release().
+ *
+ * @return true if the buzzer was claimed, false if it already is.
+ * @note Safe to call from an interrupt.
+ */
+bool buzzer_claim(void);
+
+/**
+ * @brief Give back the buzzer taken with ::buzzer_claim().
+ *
+ * Silences the buzzer and resumes the queued notes.
+ *
+ * @note Safe to call from an interrupt.
+ */
+void buzzer_release(void);
+
+/**
+ * @brief Check if queued notes are still playing.
+ *
+ * @return true while a queued tone or sequence is playing.
+ */
+bool buzzer_is_busy(void);
+
 /**
  * @brief Turn the buzzer off.
  *
- * Drives the buzzer pin low, silencing any ongoing tone.
+ * Silences any ongoing tone and drops the queued notes. The callbacks
+ * of the dropped notes are not called. A buzzer taken with ::buzzer_claim()
+ * stays claimed and its tone is left to the owner.
  */
 void buzzer_turn_off(void);
 
@@ -492,6 +644,62 @@ void pdm_microphone_set_callback(pdm_samples_ready_handler_t handler);
 int get_microphone_samples(int16_t *buffer, size_t samples);
 
 
+/* =========================
+ *  I2C
+ * ========================= */
+
+/**
+ * Longest transaction of the I²C bus service, written and read bytes
+ * together: the longest of the HAT drivers is an IMU FIFO burst (515 bytes).
+ */
+#define I2C_BUS_MAX_TRANSFER                    520
+
+/**
+ * @brief Priorities of the I²C bus queue.
+ *
+ * The bus serves the highest priority first, and in submission order within a
+ * priority. A transaction on the wire is never interrupted: the display frames
+ * are split in short transactions so that the others go between them.
+ */
+typedef enum {
+    I2C_BUS_PRIORITY_LOW = 0,   ///< Bulk transfers: the display frames.
+    I2C_BUS_PRIORITY_NORMAL,    ///< Slow sensors (VEML6030, HDC2021) and @ref i2c_write / @ref i2c_read.
+    I2C_BUS_PRIORITY_HIGH,      ///< The IMU, read at a fixed rate.
+    I2C_BUS_PRIORITIES
+} i2c_bus_priority_t;
+
+/**
+ * @brief Callback called when a queued I²C transaction has ended.
+ *
+ * @param ok        false if the device did not acknowledge.
+ * @param user_data Value of the transaction.
+ *
+ * @note It runs in the I²C interrupt: keep it short and only use
+ *       interrupt-safe calls (e.g. FreeRTOS `...FromISR` functions).
+ */
+typedef void (*i2c_bus_done_callback_t)(bool ok, void *user_data);
+
+/**
+ * @brief One I²C transaction: a write, a read, or a write then a read after a
+ * repeated start (e.g. a register address, then its value).
+ *
+ * The caller owns the structure and the buffers until the transaction has
+ * ended: they must not be on the stack of a function that returns before.
+ */
+typedef struct i2c_bus_transfer {
+    uint8_t addr;                   ///< 7-bit device address.
+    uint8_t priority;               ///< One of ::i2c_bus_priority_t.
+    const uint8_t *tx;              ///< Bytes written first (may be NULL if @c tx_len is 0).
+    size_t tx_len;                  ///< Number of bytes written.
+    uint8_t *rx;                    ///< Buffer of the bytes read (may be NULL if @c rx_len is 0).
+    size_t rx_len;                  ///< Number of bytes read.
+    i2c_bus_done_callback_t done;   ///< Called at the end (may be NULL).
+    void *user_data;                ///< Passed to @c done.
+    // Set by the bus service
+    volatile bool busy;             ///< true while queued or on the wire.
+    volatile bool ok;               ///< Result, valid when @c busy is false.
+    struct i2c_bus_transfer *next;  ///< Next one in the queue.
+} i2c_bus_transfer_t;
 
 /**
  * @brief Initialize an I²C instance with explicit pins.
@@ -499,6 +707,11 @@ int get_microphone_samples(int16_t *buffer, size_t samples);
  * Configures @c i2c_default for Fast-mode (400 kHz), sets @p sda_pin and
  * @p scl_pin to I²C function, and enables pull-ups on both lines.
  *
+ * It also starts the I²C bus service: the transactions of all the HAT
+ * drivers go through one queue and are sent with DMA, one after the other.
+ * It claims two DMA channels and the interrupt of @c i2c_default. Nothing
+ * else may use @c i2c_default directly afterwards.
+ *
  * @param sda_pin GPIO to use for SDA (e.g., @ref DEFAULT_I2C_SDA_PIN).
  * @param scl_pin GPIO to use for SCL (e.g., @ref DEFAULT_I2C_SCL_PIN).
  */
@@ -526,10 +739,49 @@ void init_i2c(uint sda_pin, uint scl_pin);
  */
 void init_i2c_default(void);
 
+/**
+ * @brief Queue an I²C transaction and return immediately.
+ *
+ * The transaction is sent with DMA when the transactions of higher priority,
+ * and the ones of the same priority queued before it, have ended. The CPU is
+ * not used while it is on the wire.
+ *
+ * @param transfer Transaction to send, with @c addr, @c priority, the
+ *                 buffers, @c done and @c user_data filled in.
+ * @return true if queued; false if it is already queued, has no bytes or
+ *         more than @ref I2C_BUS_MAX_TRANSFER, or the bus is not initialized.
+ */
+bool i2c_bus_submit(i2c_bus_transfer_t *transfer);
+
+/**
+ * @brief Queue an I²C transaction and wait for its end.
+ *
+ * Writes @p tx_len bytes, then reads @p rx_len bytes after a repeated start,
+ * in one transaction (either length may be 0, not both). It waits for the
+ * transactions before it in the queue, not for the whole display frame.
+ *
+ * @param addr     7-bit I²C device address.
+ * @param tx       Bytes to write.
+ * @param tx_len   Number of bytes to write.
+ * @param rx       Buffer of the bytes read.
+ * @param rx_len   Number of bytes to read.
+ * @param priority One of ::i2c_bus_priority_t.
+ * @return true if the device acknowledged the whole transaction.
+ *
+ * @note The calling task sleeps until the end of the transaction (task
+ *       notification index 1, so FreeRTOSConfig.h needs
+ *       `configTASK_NOTIFICATION_ARRAY_ENTRIES` of at least 2). Before the
+ *       scheduler starts it waits on the CPU. Not from an interrupt or a
+ *       done callback: it would wait forever.
+ */
+bool i2c_bus_transfer(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                      uint8_t *rx, size_t rx_len, uint8_t priority);
+
 /**
  * @brief Write data to an I²C device.
  *
- * Writes a buffer of bytes to the specified I²C address.
+ * Writes a buffer of bytes to the specified I²C address, through the
+ * I²C bus queue at @ref I2C_BUS_PRIORITY_NORMAL, and waits for the end.
  *
  * Typical usage: writing a configuration value to a sensor register.
  *
@@ -543,9 +795,12 @@ void init_i2c_default(void);
  * @param src    Pointer to data buffer to transmit.
  * @param len    Number of bytes to write.
  * @param nostop If true, the transfer does not send a STOP
- *               condition (repeated start).
+ *               condition (repeated start): the bytes (at most 16) are
+ *               kept and sent with the next @ref i2c_read to @p addr, in
+ *               the same transaction. Keep both calls in the same task:
+ *               a write with nostop of another task waits until then.
  *
- * @return @c true if all bytes were written, @c false otherwise.
+ * @return @c true if all bytes were written (or kept), @c false otherwise.
  */
 bool i2c_write(uint8_t addr, const uint8_t *src, size_t len, bool nostop);
 
@@ -572,8 +827,8 @@ bool i2c_write(uint8_t addr, const uint8_t *src, size_t len, bool nostop);
  * @param addr   7-bit I²C device address.
  * @param dst    Pointer to destination buffer.
  * @param len    Number of bytes to read.
- * @param nostop If true, the transfer does not send a STOP
- *               condition (repeated start).
+ * @param nostop Ignored: the read always ends the transaction with a
+ *               STOP condition.
  *
  * @return @c true if all bytes were read, @c false otherwise.
  */
@@ -605,10 +860,53 @@ bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop);
  *
  * @pre Call @c init_i2c_default before this function.
  *
+ * The frames go through the I²C bus queue at @ref I2C_BUS_PRIORITY_LOW: the
+ * drawing helpers queue them and return, see @ref display_flush_async.
+ *
  * @post The display is powered on and ready to draw.
  */
 void init_display(void);
 
+/**
+ * @brief Callback called when a display flush is on the panel.
+ *
+ * @param ok        false if the display did not acknowledge (the next flush
+ *                  sends the whole frame again).
+ * @param user_data Value given to @ref display_flush_async.
+ *
+ * @note It runs in the I²C interrupt: keep it short and only use
+ *       interrupt-safe calls (e.g. FreeRTOS `...FromISR` functions).
+ */
+typedef void (*display_done_callback_t)(bool ok, void *user_data);
+
+/**
+ * @brief Send what was drawn since the last flush, and return.
+ *
+ * The changed areas are copied to a second buffer and queued on the I²C bus
+ * as transactions of up to 64 bytes, so the next frame can be drawn while
+ * this one is on the wire and the sensor reads go between its transactions.
+ * If the previous flush is still running, this waits for it first.
+ *
+ * @param done      Called when the flush has ended (may be NULL).
+ * @param user_data Passed to @p done.
+ * @return true if the flush started; false if the I²C bus did not take it
+ *         (@p done is still called, with ok false).
+ */
+bool display_flush_async(display_done_callback_t done, void *user_data);
+
+/**
+ * @brief Check if a display flush is on the I²C bus.
+ */
+bool display_is_busy(void);
+
+/**
+ * @brief Wait until the display flush has left the I²C bus.
+ *
+ * The calling task sleeps until the end of the flush (on the CPU before
+ * the scheduler starts).
+ */
+void display_wait(void);
+
 /**
  * @brief Write a text string centered-ish on the display.
  *
@@ -617,7 +915,7 @@ void init_display(void);
  *
  * @param text Null-terminated C string. Ignored if @c NULL.
  *
- * @note This helper calls @c ssd1306_show() internally.
+ * @note This helper starts @ref display_flush_async and does not wait.
  * @see write_text_xy()
  */
 void write_text(const char *text);
@@ -634,10 +932,37 @@ void write_text(const char *text);
  * @param y0  Start Y in pixels (values < 0 are clamped to 0).
  * @param text Null-terminated C string. Ignored if @c NULL.
  *
- * @note Calls @c ssd1306_show() internally.
+ * @note Starts @ref display_flush_async and does not wait.
  */
 void write_text_xy(int16_t x0, int16_t y0, const char *text);
 
+/**
+ * @brief Write a text line scrolled by a pixel offset, for tickers.
+ *
+ * Draws the 128 pixel wide window of @p text that starts @p offset pixels
+ * into it, on the line of @ref write_text (font scale 2, y = 24 to 39). The
+ * line is overwritten, the rest of the display is kept. Calling it again
+ * with the offset moved by a few pixels scrolls the text smoothly: only the
+ * two pages of the line are sent, no glyph is redrawn elsewhere.
+ *
+ * @param text   Null-terminated C string, of any length. Ignored if @c NULL.
+ * @param offset Pixel of the text at the left edge of the display; negative
+ *               values start the text further right (-8 is where
+ *               @ref write_text puts it).
+ *
+ * @note Starts @ref display_flush_async and does not wait.
+ * @see text_width()
+ */
+void write_text_scroll(const char *text, int32_t offset);
+
+/**
+ * @brief Width in pixels of a text line drawn by @ref write_text_scroll.
+ *
+ * @param text Null-terminated C string (0 if @c NULL).
+ * @return Width of the text, 12 pixels per character.
+ */
+uint32_t text_width(const char *text);
+
 /**
  * @brief Set the text cursor for subsequent text rendering.
  *
@@ -662,7 +987,7 @@ void set_text_cursor (int16_t x0, int16_t y0);
  * @param r    Radius in pixels (>= 0).
  * @param fill If @c true, draws a filled disk; otherwise, only the outline.
  *
- * @post Calls @c ssd1306_show() once at the end.
+ * @post Starts @ref display_flush_async once at the end.
  * @complexity O(r)
  */
 void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill);
@@ -677,7 +1002,7 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill);
  * @param x1 End X.
  * @param y1 End Y.
  *
- * @note Calls @c ssd1306_show() internally.
+ * @note Starts @ref display_flush_async internally.
  */
 void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
 
@@ -693,7 +1018,7 @@ void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
  * @param h  Height in pixels.
  * @param fill If @c true, filled rectangle; otherwise, outline only.
  *
- * @note Calls @c ssd1306_show() internally.
+ * @note Starts @ref display_flush_async internally.
  */
 void draw_square(uint32_t x, uint32_t y, uint32_t w, uint32_t h, bool fill);
 
@@ -902,6 +1227,8 @@ float hdc2021_read_humidity(void);
  *
  * ### Modes
  * - This SDK supports **Low-Noise (LN) mode** (higher precision, higher power).
+ * - Samples can be polled (::ICM42670_read_sensor_data) or streamed in bursts
+ *   through the on-chip FIFO (::ICM42670_fifo_enable, ::ICM42670_fifo_read).
  * - Other modes (LP/ULP/hybrid) are not yet implemented in this SDK.
  *
  * @see Datasheet: https://invensense.tdk.com/wp-content/uploads/2021/07/DS-000451-ICM-42670-P-v1.0.pdf
@@ -989,6 +1316,297 @@ int ICM42670_read_sensor_data(float *ax, float *ay, float *az,
                               float *gx, float *gy, float *gz,
                               float *t);
 
+/**
+ * @brief Raw accelerometer, gyroscope and temperature counts.
+ *
+ * Read with ::ICM42670_read_raw. Use the ::icm42670_scale_t of the current
+ * full-scale ranges to turn physical thresholds into counts once, instead of
+ * converting every sample.
+ */
+typedef struct {
+    int16_t accel[3];       ///< X, Y, Z acceleration (raw counts)
+    int16_t gyro[3];        ///< X, Y, Z angular rate (raw counts)
+    int16_t temperature;    ///< Temperature, °C = value / 128 + 25
+} icm42670_raw_data_t;
+
+/**
+ * @brief Sensitivity of the configured full-scale ranges.
+ *
+ * Updated by ::ICM42670_startAccel and ::ICM42670_startGyro. Valid for
+ * ::ICM42670_read_raw and for the FIFO packets.
+ */
+typedef struct {
+    uint16_t accel_lsb_per_g;         ///< Counts for 1 g (16384, 8192, 4096, 2048)
+    uint16_t gyro_lsb_per_dps_x10;    ///< Counts for 10 dps (1310, 655, 328, 164)
+} icm42670_scale_t;
+
+/**
+ * @brief Read accelerometer, gyroscope and temperature as raw counts.
+ *
+ * Same 14-byte read as ::ICM42670_read_sensor_data without any float
+ * conversion, for the sensor path on cores without FPU.
+ *
+ * @param data  Pointer to store the raw counts.
+ * @param scale Optional pointer to store the current sensitivity (may be NULL).
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_read_raw(icm42670_raw_data_t *data, icm42670_scale_t *scale);
+
+/**
+ * @brief Get the sensitivity of the current full-scale ranges.
+ *
+ * @param scale Pointer to store the sensitivity.
+ */
+void ICM42670_get_scale(icm42670_scale_t *scale);
+
+/**
+ * @brief Convert an acceleration threshold to raw counts.
+ *
+ * @param scale Sensitivity from ::ICM42670_get_scale.
+ * @param mg    Acceleration in milli-g.
+ *
+ * @return Acceleration in raw counts.
+ */
+int32_t ICM42670_accel_mg_to_raw(const icm42670_scale_t *scale, int32_t mg);
+
+/**
+ * @brief Convert an angular rate threshold to raw counts.
+ *
+ * @param scale Sensitivity from ::ICM42670_get_scale.
+ * @param dps   Angular rate in degrees/second.
+ *
+ * @return Angular rate in raw counts.
+ */
+int32_t ICM42670_gyro_dps_to_raw(const icm42670_scale_t *scale, int32_t dps);
+
+/**
+ * @brief One accel + gyro sample read from the IMU FIFO.
+ *
+ * Values are the raw sensor counts. Divide the accelerometer by the LSB/g and
+ * the gyroscope by the LSB/dps of the configured full-scale ranges, or use
+ * ::ICM42670_fifo_packet_to_float.
+ */
+typedef struct {
+    int16_t accel[3];       ///< X, Y, Z acceleration (raw counts)
+    int16_t gyro[3];        ///< X, Y, Z angular rate (raw counts)
+    int8_t temperature;     ///< Temperature, °C = value / 2 + 25
+    uint16_t timestamp;     ///< Sensor timestamp in µs, wraps every 65.5 ms
+} icm42670_fifo_packet_t;
+
+/**
+ * @brief Enable the on-chip FIFO in stream mode with a watermark interrupt.
+ *
+ * Both accelerometer and gyroscope samples are stored (16-byte packets) at the
+ * configured ODR. When @p watermark packets are waiting, the FIFO threshold
+ * interrupt is raised on INT1 and ::ICM42670_fifo_read can drain them all in
+ * a single I2C transaction.
+ *
+ * @param watermark Number of packets that raise the interrupt
+ *                  (1 .. @ref ICM42670_FIFO_MAX_BURST).
+ *
+ * @pre Start the sensors (e.g. ::ICM42670_start_with_default_values) first.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_fifo_enable(uint16_t watermark);
+
+/**
+ * @brief Stop storing samples in the FIFO and disable its interrupt.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_fifo_disable(void);
+
+/**
+ * @brief Drop every packet stored in the FIFO.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_fifo_flush(void);
+
+/**
+ * @brief Read how many packets are waiting in the FIFO.
+ *
+ * @param count Pointer to store the number of packets.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_fifo_count(uint16_t *count);
+
+/**
+ * @brief Drain up to @p max_packets packets from the FIFO in one burst.
+ *
+ * The FIFO count and @p max_packets packets are read in a single I2C
+ * transaction, so no separate count read is needed. Every packet read before
+ * the first empty one is copied to @p packets, also the ones stored during the
+ * read (after the count was latched).
+ *
+ * @param packets     Buffer for the decoded packets.
+ * @param max_packets Size of @p packets (at most @ref ICM42670_FIFO_MAX_BURST).
+ *                    Usually the watermark passed to ::ICM42670_fifo_enable.
+ * @param remaining   Optional pointer to store how many packets are still
+ *                    waiting after this read (may be NULL).
+ *
+ * @return Number of packets copied to @p packets, negative value on error.
+ */
+int ICM42670_fifo_read(icm42670_fifo_packet_t *packets, size_t max_packets,
+                       uint16_t *remaining);
+
+/**
+ * @brief Configure the INT1 pin and route interrupt sources to it.
+ *
+ * INT1 is configured as push-pull, active-low and pulsed
+ * (@ref ICM42670_INT1_CONFIG_VALUE) and the @ref ICM42670_INT GPIO is set as
+ * input. Enable a falling edge interruption on that GPIO to be notified.
+ *
+ * @param sources INT_SOURCE0 bits to add, e.g. @ref ICM42670_FIFO_THS_INT1_EN
+ *                or @ref ICM42670_DRDY_INT1_EN (0 only configures the pin).
+ *
+ * @note Call it after the sensors are started: writing INT_CONFIG right after
+ *       the soft reset of ::init_ICM42670 can block the sensor after a cold
+ *       power-on.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_enable_int1(uint8_t sources);
+
+/**
+ * @brief Sleep until the board moves: accelerometer in low power, gyroscope off.
+ *
+ * The accelerometer samples at @p lp_odr_hz in low-power mode and raises the
+ * wake-on-motion interrupt on INT1 when an axis changes by more than
+ * @p threshold_mg from one sample to the next. The FIFO and its interrupt are
+ * disabled so they do not wake the MCU. Leave with ::ICM42670_disable_wom.
+ *
+ * @param threshold_mg Acceleration change that wakes (4 .. 996 mg, 3.9 mg steps).
+ * @param lp_odr_hz    Low-power output data rate (25, 50, 100, 200 or 400 Hz).
+ *
+ * @pre Start the sensors first. Their ODR and ranges are restored by
+ *      ::ICM42670_disable_wom.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_enable_wom(uint16_t threshold_mg, uint16_t lp_odr_hz);
+
+/**
+ * @brief Stop the wake-on-motion interrupt and go back to low-noise mode.
+ *
+ * The accelerometer and gyroscope are restarted with the ODR and ranges they
+ * had before ::ICM42670_enable_wom. Enable the FIFO again with
+ * ::ICM42670_fifo_enable to stream samples.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_disable_wom(void);
+
+/**
+ * @brief Read and clear the wake-on-motion status.
+ *
+ * @param status Pointer to store the INT_STATUS2 bits
+ *               (@ref ICM42670_WOM_XYZ_INT: an axis moved).
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_wom_status(uint8_t *status);
+
+/**
+ * @brief Convert a FIFO packet with the current full-scale ranges.
+ *
+ * Uses the same units as ::ICM42670_read_sensor_data.
+ *
+ * @param packet Packet returned by ::ICM42670_fifo_read.
+ * @param ax, ay, az Pointers to store the acceleration (g).
+ * @param gx, gy, gz Pointers to store the angular rate (dps).
+ * @param t          Pointer to store the temperature (°C).
+ */
+void ICM42670_fifo_packet_to_float(const icm42670_fifo_packet_t *packet,
+                                   float *ax, float *ay, float *az,
+                                   float *gx, float *gy, float *gz,
+                                   float *t);
+
+/**
+ * @brief Offsets measured by ::ICM42670_calibrate.
+ *
+ * Counts of the full-scale ranges stored in @p scale. Once applied with
+ * ::ICM42670_set_offsets they are subtracted from every sample returned by
+ * ::ICM42670_read_raw and ::ICM42670_fifo_read, also after the ranges change.
+ */
+typedef struct {
+    int16_t accel[3];       ///< Accelerometer zero-g offsets (gravity removed)
+    int16_t gyro[3];        ///< Gyroscope zero-rate offsets at @p temperature
+    int16_t gyro_tc_q8[3];  ///< Gyroscope offset change per FIFO temperature count, Q8 (0 = unknown)
+    icm42670_scale_t scale; ///< Sensitivity the offsets were measured with
+    int8_t temperature;     ///< FIFO temperature while measuring, °C = value / 2 + 25
+} icm42670_offsets_t;
+
+/**
+ * @brief Measure the accelerometer and gyroscope offsets of a board lying still.
+ *
+ * Averages @p samples FIFO packets. The axis with the largest acceleration is
+ * taken as the gravity axis and 1 g is removed from it, so the board may lie
+ * on any side. The current offsets are cleared while measuring; apply the
+ * result with ::ICM42670_set_offsets.
+ *
+ * If @p previous was measured at least @ref ICM42670_CALIB_TC_MIN_DELTA
+ * temperature counts away, the gyroscope temperature coefficient is learned
+ * from the two measurements, otherwise the one of @p previous is kept.
+ *
+ * @param samples  Packets to average (1 .. @ref ICM42670_CALIB_MAX_SAMPLES).
+ * @param previous Offsets of an earlier calibration, e.g. from
+ *                 ::ICM42670_load_offsets (may be NULL).
+ * @param offsets  Pointer to store the measured offsets.
+ *
+ * @pre Start the sensors and enable the FIFO (::ICM42670_fifo_enable).
+ *
+ * @return 0 on success, -4 if the board moved while measuring, other negative
+ *         values on error.
+ */
+int ICM42670_calibrate(uint16_t samples, const icm42670_offsets_t *previous,
+                       icm42670_offsets_t *offsets);
+
+/**
+ * @brief Subtract the given offsets from every following sample.
+ *
+ * The offsets are rescaled once to the current full-scale ranges. The
+ * gyroscope offset follows the FIFO temperature with the learned coefficient;
+ * it is only recomputed when the temperature changes.
+ *
+ * @param offsets Offsets to apply, NULL to stop correcting the samples.
+ */
+void ICM42670_set_offsets(const icm42670_offsets_t *offsets);
+
+/**
+ * @brief Get the offsets currently applied.
+ *
+ * @param offsets Pointer to store the offsets.
+ *
+ * @return true if offsets are applied, false otherwise.
+ */
+bool ICM42670_get_offsets(icm42670_offsets_t *offsets);
+
+/**
+ * @brief Store offsets in the last flash sector.
+ *
+ * The next boot can load them with ::ICM42670_load_offsets instead of waiting
+ * for the board to lie still. Interrupts are disabled while the sector is
+ * erased and written (tens of ms).
+ *
+ * @param offsets Offsets to store.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_save_offsets(const icm42670_offsets_t *offsets);
+
+/**
+ * @brief Load the offsets stored by ::ICM42670_save_offsets.
+ *
+ * @param offsets Pointer to store the offsets.
+ *
+ * @return 0 on success, negative value if no valid offsets are stored.
+ */
+int ICM42670_load_offsets(icm42670_offsets_t *offsets);
+
 /** @} */ // end of group ICM42670
 
 
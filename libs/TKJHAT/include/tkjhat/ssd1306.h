@@ -56,6 +56,48 @@ typedef enum {
     SET_CHARGE_PUMP = 0x8D
 } ssd1306_command_t;
 
+#define SSD1306_MAX_PAGES 8 /**< pages of the largest display (64 rows) */
+
+/**
+*	@brief i2c bytes of one more partial update besides its data (address commands, control bytes, addressing).
+*	ssd1306_show() sends neighbouring pages in one update when that costs less than this.
+*/
+#define SSD1306_UPDATE_OVERHEAD 12
+
+#define SSD1306_GLYPH_CACHE_SLOTS 4		/**< fonts and scales whose glyphs are kept rendered */
+#define SSD1306_GLYPH_CACHE_MAX_SCALE 4	/**< larger scales are drawn pixel by pixel */
+
+/**
+*	@brief data bytes of one i2c transaction of an update, other users of a shared bus can go between two of them.
+*	The display goes on writing its ram where the last transaction ended.
+*/
+#define SSD1306_UPDATE_CHUNK 64
+
+/**
+*	@brief i2c transactions of the largest update: per page an address command and a chunk that is not full,
+*	and the full chunks of a 128x64 frame
+*/
+#define SSD1306_MAX_TRANSACTIONS (2*SSD1306_MAX_PAGES+128*SSD1306_MAX_PAGES/SSD1306_UPDATE_CHUNK)
+
+/**
+*	@brief sends one i2c transaction to the display, for a display on a bus that other code also uses
+*
+*	@param[in] address : i2c address of display
+*	@param[in] src : bytes of the transaction, starting with the control byte
+*	@param[in] len : number of bytes
+*
+*	@return true if the display acknowledged all bytes
+*/
+typedef bool (*ssd1306_write_t)(uint8_t address, const uint8_t *src, size_t len);
+
+/**
+*	@brief one i2c transaction of an update, in txbuf
+*/
+typedef struct {
+    uint16_t offset;	/**< first byte in txbuf */
+    uint16_t len;		/**< number of bytes */
+} ssd1306_transaction_t;
+
 /**
 *	@brief holds the configuration
 */
@@ -66,13 +108,23 @@ typedef struct {
     uint8_t address; 	/**< i2c address of display*/
     i2c_inst_t *i2c_i; 	/**< i2c connection instance */
     bool external_vcc; 	/**< whether display uses external vcc */ 
+    ssd1306_write_t write;	/**< sends the transactions instead of blocking writes to i2c_i, if not NULL */
     uint8_t *buffer;	/**< display buffer */
     size_t bufsize;		/**< buffer size */
+    uint8_t *shadow;	/**< copy of the display ram, what the last ssd1306_show() sent */
+    uint8_t *txbuf;		/**< i2c transactions of the last update, the back buffer */
+    ssd1306_transaction_t tx[SSD1306_MAX_TRANSACTIONS];	/**< transactions of the last update, in order */
+    uint8_t txcount;	/**< number of transactions of the last update */
+    bool shadow_valid;	/**< false until the whole display ram was written once */
+    uint8_t dirty_x0[SSD1306_MAX_PAGES];	/**< first column drawn on each page since the last show, dirty_x0>dirty_x1 when clean */
+    uint8_t dirty_x1[SSD1306_MAX_PAGES];	/**< last column drawn on each page since the last show */
 } ssd1306_t;
 
 /**
 *	@brief initialize display
 *
+*	p->external_vcc and p->write are set by the caller before.
+*
 *	@param[in] p : pointer to instance of ssd1306_t
 *	@param[in] width : width of display
 *	@param[in] height : heigth of display
@@ -130,11 +182,46 @@ void ssd1306_invert(ssd1306_t *p, uint8_t inv);
 /**
 	@brief display buffer, should be called on change
 
+	Only the columns of each page that were drawn since the last call and differ from the display ram are
+	sent, neighbouring pages merged into one update when cheaper. With p->write set, they go through it.
+
 	@param[in] p : instance of display
 
 */
 void ssd1306_show(ssd1306_t *p);
 
+/**
+	@brief collect the changes since the last show as i2c transactions, for sending them another way than ssd1306_show()
+
+	The transactions are p->tx[0..p->txcount-1], in p->txbuf, and must be sent in order. They stay valid until the
+	next update, drawing the next frame can go on while they are on the wire.
+
+	@param[in] p : instance of display
+
+	@return bool.
+	@retval true if there is something to send
+	@retval false if nothing changed
+*/
+bool ssd1306_prepare_update(ssd1306_t *p);
+
+/**
+	@brief forget what the display ram holds, after a transaction of an update failed: the next show sends everything
+
+	@param[in] p : instance of display
+*/
+void ssd1306_invalidate(ssd1306_t *p);
+
+/**
+	@brief mark an area as changed, for code writing p->buffer directly (the draw functions mark what they draw)
+
+	@param[in] p : instance of display
+	@param[in] x : x position of starting point
+	@param[in] y : y position of starting point
+	@param[in] width : width of area
+	@param[in] height : height of area
+*/
+void ssd1306_mark_dirty(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
 /**
 	@brief clear display buffer
 
@@ -225,6 +312,22 @@ void ssd1306_bmp_show_image_with_offset(ssd1306_t *p, const uint8_t *data, const
 */
 void ssd1306_bmp_show_image(ssd1306_t *p, const uint8_t *data, const long size);
 
+/**
+	@brief render the glyphs of a font at a scale now instead of on first use
+
+	Text is drawn from rendered glyphs, in the column byte format of the display, that are or-ed into the
+	buffer a column at a time. They are rendered the first time a font is drawn at a scale. Fonts up to 8 pixels
+	high and scales up to SSD1306_GLYPH_CACHE_MAX_SCALE are cached, in up to SSD1306_GLYPH_CACHE_SLOTS slots.
+
+	@param[in] font : pointer to font
+	@param[in] scale : scale of the font
+
+	@return bool.
+	@retval true if the glyphs are cached
+	@retval false if the font or scale cannot be cached, or no slot or memory is free (drawn pixel by pixel then)
+*/
+bool ssd1306_glyph_cache_init(const uint8_t *font, uint32_t scale);
+
 /**
 	@brief draw char with given font
 
@@ -271,4 +374,41 @@ void ssd1306_draw_string_with_font(ssd1306_t *p, uint32_t x, uint32_t y, uint32_
 */
 void ssd1306_draw_string(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t scale, const char *s);
 
+/**
+	@brief draw a window of a text line scrolled by a pixel offset, for tickers
+
+	The text is seen as a strip of columns: the display width starting at column offset of the strip is drawn on
+	the pages page..page+scale-1, which are overwritten (blank where there is no text). Moving offset by one
+	scrolls the text by one pixel without redrawing the rest of the display.
+
+	@param[in] p : instance of display
+	@param[in] page : first page (8 rows) of the line
+	@param[in] scale : scale font to n times of original size, the line is scale pages high
+	@param[in] font : pointer to font, at most 8 pixels high
+	@param[in] s : text of the line
+	@param[in] offset : column of the text at the left edge of the display, negative to start further right
+*/
+void ssd1306_draw_string_window_with_font(ssd1306_t *p, uint32_t page, uint32_t scale, const uint8_t *font, const char *s, int32_t offset);
+
+/**
+	@brief draw a window of a text line scrolled by a pixel offset with builtin font
+
+	@param[in] p : instance of display
+	@param[in] page : first page (8 rows) of the line
+	@param[in] scale : scale font to n times of original size, the line is scale pages high
+	@param[in] s : text of the line
+	@param[in] offset : column of the text at the left edge of the display, negative to start further right
+*/
+void ssd1306_draw_string_window(ssd1306_t *p, uint32_t page, uint32_t scale, const char *s, int32_t offset);
+
+/**
+	@brief width in pixels of a text with builtin font
+
+	@param[in] scale : scale of the font
+	@param[in] s : text
+
+	@return width of the text, spacing after the last character included
+*/
+uint32_t ssd1306_string_width(uint32_t scale, const char *s);
+
 #endif
\ No newline at end of file
@@ -29,10 +29,22 @@ SOFTWARE.
 
 //#include "tusb.h" //is it needed?
 #include "hardware/irq.h"
+#include "hardware/dma.h"
 #include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "pico/critical_section.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <timers.h>
 #include <tkjhat/ssd1306.h>
 #include <tkjhat/pdm_microphone.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
 #include <math.h>
 
 
@@ -214,62 +226,576 @@ void stop_rgb_led(){
  *  BUZZER
  * ========================= */
 
+// PWM clock = 125 MHz / 64, so tones from ~30 Hz up fit in the 16-bit wrap
+#define BUZZER_PWM_CLKDIV 64
+
+typedef struct {
+    uint32_t frequency;
+    uint32_t duration_ms;
+    buzzer_done_callback_t done; // Only set on the last note of a tone/sequence
+    void *user_data;
+} buzzer_entry_t;
+
+// Notes waiting or playing, the first one (buzzer_head) is the one playing
+static buzzer_entry_t buzzer_queue[BUZZER_QUEUE_LENGTH];
+static uint8_t buzzer_head = 0;
+static uint8_t buzzer_count = 0;
+static volatile bool buzzer_playing = false;
+static alarm_id_t buzzer_alarm = 0;
+// Set by buzzer_claim(): the owner drives the tone itself and the queue waits
+static bool buzzer_claimed = false;
+// Shared by the callers and the alarm interrupt (works on both cores)
+static critical_section_t buzzer_lock;
+
  void init_buzzer() {
-    // Initialize the buzzer pin as an output
-    gpio_init(BUZZER_PIN);
-    gpio_set_dir(BUZZER_PIN, GPIO_OUT);
+    // The buzzer pin is driven by the PWM (slice 0, channel B), level 0 = silent
+    if (!critical_section_is_initialized(&buzzer_lock)) {
+        critical_section_init(&buzzer_lock);
+    }
+    gpio_set_function(BUZZER_PIN, GPIO_FUNC_PWM);
+    uint slice_num = pwm_gpio_to_slice_num(BUZZER_PIN);
+    pwm_set_clkdiv(slice_num, BUZZER_PWM_CLKDIV);
+    pwm_set_gpio_level(BUZZER_PIN, 0);
+    pwm_set_enabled(slice_num, true);
 }
 
- void buzzer_play_tone(uint32_t frequency, uint32_t duration_ms) {
-    // Calculate the period (in microseconds) and number of cycles
-    uint32_t period_us = 1000000 / frequency;
-    uint32_t num_cycles = duration_ms * frequency / 1000;
+void buzzer_set_tone(uint32_t frequency) {
+    if (frequency == 0) {
+        pwm_set_gpio_level(BUZZER_PIN, 0);
+        return;
+    }
+    // One PWM period per tone period, 50% duty cycle
+    uint32_t top = clock_get_hz(clk_sys) / BUZZER_PWM_CLKDIV / frequency;
+    if (top > 65536) top = 65536;
+    if (top < 2) top = 2;
+    pwm_set_wrap(pwm_gpio_to_slice_num(BUZZER_PIN), (uint16_t)(top - 1));
+    pwm_set_gpio_level(BUZZER_PIN, (uint16_t)(top / 2));
+}
+
+// End of the playing note: start the next queued one or stop. Runs in the timer interrupt.
+static int64_t buzzer_alarm_callback(alarm_id_t id, void *user_data) {
+    (void)user_data;
+    buzzer_entry_t finished;
+    buzzer_entry_t next = {0};
+    bool more;
+    critical_section_enter_blocking(&buzzer_lock);
+    if (id != buzzer_alarm) {
+        // Cancelled by buzzer_turn_off() while this was already running
+        critical_section_exit(&buzzer_lock);
+        return 0;
+    }
+    finished = buzzer_queue[buzzer_head];
+    buzzer_head = (buzzer_head + 1) % BUZZER_QUEUE_LENGTH;
+    buzzer_count--;
+    more = buzzer_count > 0;
+    if (more) {
+        next = buzzer_queue[buzzer_head];
+    } else {
+        buzzer_playing = false;
+        buzzer_alarm = 0;
+    }
+    buzzer_set_tone(more ? next.frequency : 0);
+    critical_section_exit(&buzzer_lock);
 
-    // Generate the tone by toggling the buzzer pin at the specified frequency
-    for (uint32_t i = 0; i < num_cycles; i++) {
-        gpio_put(BUZZER_PIN, 1);
-        busy_wait_us(period_us / 2);
-        gpio_put(BUZZER_PIN, 0);
-        busy_wait_us(period_us / 2);
+    if (finished.done) {
+        finished.done(finished.user_data);
     }
+    // Returning the duration re-arms this alarm for the next note
+    return more ? (int64_t)(next.duration_ms ? next.duration_ms : 1) * 1000 : 0;
+}
+
+// Start the note at buzzer_head, called with buzzer_lock held. The alarm id is published before the lock is
+// released so buzzer_turn_off() always cancels the alarm that is really armed.
+static bool buzzer_start_locked(void) {
+    const buzzer_entry_t *first = &buzzer_queue[buzzer_head];
+    // Never fired from here if already past: the callback takes buzzer_lock
+    alarm_id_t alarm = add_alarm_in_ms(first->duration_ms ? first->duration_ms : 1, buzzer_alarm_callback, NULL, false);
+    if (alarm <= 0) {
+        // No alarm slot left: drop the queue rather than leave a note playing forever
+        buzzer_count = 0;
+        buzzer_playing = false;
+        buzzer_alarm = 0;
+        buzzer_set_tone(0);
+        return false;
+    }
+    buzzer_set_tone(first->frequency);
+    buzzer_alarm = alarm;
+    buzzer_playing = true;
+    return true;
+}
+
+// Add entries to the queue and start playing if the buzzer was idle
+static bool buzzer_enqueue(const buzzer_entry_t *entries, size_t count) {
+    bool ok = true;
+    critical_section_enter_blocking(&buzzer_lock);
+    if (count == 0 || buzzer_count + count > BUZZER_QUEUE_LENGTH) {
+        critical_section_exit(&buzzer_lock);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        buzzer_queue[(buzzer_head + buzzer_count) % BUZZER_QUEUE_LENGTH] = entries[i];
+        buzzer_count++;
+    }
+    if (!buzzer_playing && !buzzer_claimed) {
+        // The alarm callback takes over from here, nothing is waiting on the CPU
+        ok = buzzer_start_locked();
+    }
+    critical_section_exit(&buzzer_lock);
+    return ok;
+}
+
+bool buzzer_play_tone_async(uint32_t frequency, uint32_t duration_ms,
+                            buzzer_done_callback_t done, void *user_data) {
+    buzzer_entry_t entry = {frequency, duration_ms, done, user_data};
+    return buzzer_enqueue(&entry, 1);
+}
+
+bool buzzer_play_sequence_async(const buzzer_note_t *notes, size_t count,
+                                buzzer_done_callback_t done, void *user_data) {
+    buzzer_entry_t entries[BUZZER_QUEUE_LENGTH];
+    if (count == 0 || count > BUZZER_QUEUE_LENGTH) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        entries[i].frequency = notes[i].frequency;
+        entries[i].duration_ms = notes[i].duration_ms;
+        // Only the last note reports the end of the sequence
+        entries[i].done = (i == count - 1) ? done : NULL;
+        entries[i].user_data = user_data;
+    }
+    return buzzer_enqueue(entries, count);
+}
+
+bool buzzer_claim() {
+    critical_section_enter_blocking(&buzzer_lock);
+    if (buzzer_claimed) {
+        critical_section_exit(&buzzer_lock);
+        return false;
+    }
+    buzzer_claimed = true;
+    // The playing note is cut and stays at the head of the queue, it plays again in full after buzzer_release()
+    alarm_id_t alarm = buzzer_alarm;
+    buzzer_alarm = 0;
+    buzzer_playing = false;
+    buzzer_set_tone(0);
+    critical_section_exit(&buzzer_lock);
+    if (alarm > 0) {
+        cancel_alarm(alarm);
+    }
+    return true;
+}
+
+void buzzer_release() {
+    critical_section_enter_blocking(&buzzer_lock);
+    buzzer_claimed = false;
+    buzzer_set_tone(0);
+    if (buzzer_count > 0 && !buzzer_playing) {
+        buzzer_start_locked();
+    }
+    critical_section_exit(&buzzer_lock);
+}
+
+bool buzzer_is_busy() {
+    return buzzer_playing;
+}
+
+ void buzzer_play_tone(uint32_t frequency, uint32_t duration_ms) {
+    // The PWM makes the sound, the CPU only waits (a task delay under FreeRTOS)
+    buzzer_set_tone(frequency);
+    sleep_ms(duration_ms);
+    buzzer_set_tone(0);
 }
 
  void buzzer_turn_off() {
-    // Turn off the buzzer by setting the pin to low
-    gpio_put(BUZZER_PIN, 0);
+    // Stop the running note and drop the queue
+    critical_section_enter_blocking(&buzzer_lock);
+    alarm_id_t alarm = buzzer_alarm;
+    buzzer_alarm = 0;
+    buzzer_count = 0;
+    buzzer_playing = false;
+    if (!buzzer_claimed) {
+        // A claimed buzzer is silenced by its owner
+        buzzer_set_tone(0);
+    }
+    critical_section_exit(&buzzer_lock);
+    if (alarm > 0) {
+        cancel_alarm(alarm);
+    }
 }
 
 void deinit_buzzer() {
     // Deinitialize the buzzer pin
+    buzzer_turn_off();
+    pwm_set_enabled(pwm_gpio_to_slice_num(BUZZER_PIN), false);
     gpio_deinit(BUZZER_PIN);
 }
 
 /* =========================
  *  I2C
  * ========================= */
+// The I2C bus service: every transaction on i2c_default goes through one queue and is sent with DMA. The queue is
+// served by priority, in order within a priority, from the interrupt at the end of the last transaction: a display
+// frame is a row of short transactions and the IMU reads go between them, no driver waits for a whole frame.
+
+// Task notification that wakes the caller of a blocking transfer, index 0 stays free for the application
+#define I2C_BUS_NOTIFY_INDEX 1
+#if configTASK_NOTIFICATION_ARRAY_ENTRIES <= I2C_BUS_NOTIFY_INDEX
+#error "The I2C bus service needs configTASK_NOTIFICATION_ARRAY_ENTRIES >= 2 in FreeRTOSConfig.h"
+#endif
+// Clock of the bus, also used to set it up again after a reset
+#define I2C_BUS_BAUDRATE (400*1000)
+// Longest wait for the stop condition after an abort (a few bit times, more if a device stretches the clock), out of
+// the interrupt: see i2c_bus_recover()
+#define I2C_BUS_STOP_TIMEOUT_US 1000
+// Bytes of a write with nostop kept for the read that follows it
+#define I2C_NOSTOP_WRITE_MAX 16
+
+// Queued transactions by priority, first and last of each
+static i2c_bus_transfer_t *i2c_bus_head[I2C_BUS_PRIORITIES];
+static i2c_bus_transfer_t *i2c_bus_tail[I2C_BUS_PRIORITIES];
+// Transaction on the wire, NULL when the bus is free
+static i2c_bus_transfer_t *i2c_bus_current = NULL;
+// Data commands of the transaction on the wire: the bytes written, then one read command per byte read
+static uint16_t i2c_bus_words[I2C_BUS_MAX_TRANSFER];
+static int i2c_bus_tx_channel = -1;
+static int i2c_bus_rx_channel = -1;
+// Shared by the callers and the I2C interrupt (works on both cores)
+static critical_section_t i2c_bus_lock;
+// An abort ended the last transaction before the stop it sends was on the bus: nothing starts until the stop came or
+// i2c_bus_recover() reset the I2C, and only one caller recovers at a time
+static volatile bool i2c_bus_stop_pending = false;
+static bool i2c_bus_recovering = false;
+// A write with nostop waits here for the read that follows it: both go in one transaction. The task that kept it
+// holds i2c_nostop_mutex until then, a write with nostop of another task waits for it.
+static SemaphoreHandle_t i2c_nostop_mutex = NULL;
+static uint8_t i2c_nostop_data[I2C_NOSTOP_WRITE_MAX];
+static size_t i2c_nostop_len = 0;
+static uint8_t i2c_nostop_addr;
+
+
+// Start the next queued transaction if the bus is free. Called with i2c_bus_lock held.
+static void i2c_bus_start_next(void) {
+    if (i2c_bus_current != NULL) {
+        return;
+    }
+    i2c_hw_t *hw = i2c_get_hw(i2c_default);
+    if (i2c_bus_stop_pending) {
+        if (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+            return;
+        }
+        (void)hw->clr_stop_det;
+        i2c_bus_stop_pending = false;
+    }
+    i2c_bus_transfer_t *t = NULL;
+    for (int priority = I2C_BUS_PRIORITIES - 1; priority >= 0 && t == NULL; priority--) {
+        t = i2c_bus_head[priority];
+        if (t != NULL) {
+            i2c_bus_head[priority] = t->next;
+            if (i2c_bus_head[priority] == NULL) {
+                i2c_bus_tail[priority] = NULL;
+            }
+        }
+    }
+    if (t == NULL) {
+        return;
+    }
+    i2c_bus_current = t;
+
+    size_t count = 0;
+    for (size_t i = 0; i < t->tx_len; i++) {
+        i2c_bus_words[count++] = t->tx[i];
+    }
+    for (size_t i = 0; i < t->rx_len; i++) {
+        i2c_bus_words[count++] = I2C_IC_DATA_CMD_CMD_BITS;
+    }
+    if (t->tx_len > 0 && t->rx_len > 0) {
+        i2c_bus_words[t->tx_len] |= I2C_IC_DATA_CMD_RESTART_BITS;
+    }
+    i2c_bus_words[count - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    hw->enable = 0;
+    hw->tar = t->addr;
+    hw->enable = 1;
+    (void)hw->clr_stop_det;
+    (void)hw->clr_tx_abrt;
+    if (t->rx_len > 0) {
+        dma_channel_transfer_to_buffer_now(i2c_bus_rx_channel, t->rx, t->rx_len);
+    }
+    // The end of a transaction is the stop condition on the bus, not the end of the DMA (the words are then only in the FIFO)
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+    dma_channel_transfer_from_buffer_now(i2c_bus_tx_channel, i2c_bus_words, count);
+}
+
+// The stop after an abort never came: reset the I2C block so the next transaction starts clean
+static void i2c_bus_reset(void) {
+    i2c_init(i2c_default, I2C_BUS_BAUDRATE);
+    i2c_get_hw(i2c_default)->intr_mask = 0;
+}
+
+// Out of the interrupt: wait for the stop after an abort, reset the I2C if it does not come, and start the queued
+// transactions again. Returns at once when no abort is pending.
+static void i2c_bus_recover(void) {
+    critical_section_enter_blocking(&i2c_bus_lock);
+    bool recover = i2c_bus_stop_pending && !i2c_bus_recovering;
+    i2c_bus_recovering = recover;
+    critical_section_exit(&i2c_bus_lock);
+    if (!recover) {
+        return;
+    }
+
+    i2c_hw_t *hw = i2c_get_hw(i2c_default);
+    uint32_t start = time_us_32();
+    while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+        if (time_us_32() - start > I2C_BUS_STOP_TIMEOUT_US) {
+            i2c_bus_reset();
+            break;
+        }
+        tight_loop_contents();
+    }
+    (void)hw->clr_stop_det;
+
+    critical_section_enter_blocking(&i2c_bus_lock);
+    i2c_bus_stop_pending = false;
+    i2c_bus_recovering = false;
+    i2c_bus_start_next();
+    critical_section_exit(&i2c_bus_lock);
+}
+
+// i2c_bus_recover() in the timer task, pended by the interrupt
+static void i2c_bus_recover_pended(void *param1, uint32_t param2) {
+    (void)param1;
+    (void)param2;
+    i2c_bus_recover();
+}
+
+// Stop condition or abort at the end of a transaction: report it and start the next one
+static void i2c_bus_irq(void) {
+    i2c_hw_t *hw = i2c_get_hw(i2c_default);
+    uint32_t stat = hw->intr_stat;
+    bool ok = true;
+    bool stop_pending = false;
+    if (stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // Not acknowledged: the I2C flushed its FIFO, stop the rest of the words too. The stop it sends is not waited
+        // for here, the next transaction starts after it (i2c_bus_start_next, i2c_bus_recover).
+        dma_channel_abort(i2c_bus_tx_channel);
+        dma_channel_abort(i2c_bus_rx_channel);
+        (void)hw->clr_tx_abrt;
+        stop_pending = !(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS);
+        ok = false;
+    } else if (!(stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS)) {
+        return;
+    }
+    if (!stop_pending) {
+        (void)hw->clr_stop_det;
+    }
+    hw->intr_mask = 0;
+
+    i2c_bus_transfer_t *finished = i2c_bus_current;
+    if (finished == NULL) {
+        return;
+    }
+    if (ok && finished->rx_len > 0) {
+        // The last byte read can still be on its way from the FIFO to the buffer
+        dma_channel_wait_for_finish_blocking(i2c_bus_rx_channel);
+    }
+
+    critical_section_enter_blocking(&i2c_bus_lock);
+    // The caller may reuse the transaction as soon as busy is false: take what the callback needs first
+    i2c_bus_done_callback_t done = finished->done;
+    void *user_data = finished->user_data;
+    finished->ok = ok;
+    finished->busy = false;
+    i2c_bus_current = NULL;
+    i2c_bus_stop_pending = stop_pending;
+    i2c_bus_start_next();
+    // Still waiting for the stop: the timer task takes the queue from there. Before the scheduler the waiting loops do.
+    bool recover = i2c_bus_stop_pending && i2c_bus_current == NULL;
+    critical_section_exit(&i2c_bus_lock);
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (recover && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        xTimerPendFunctionCallFromISR(i2c_bus_recover_pended, NULL, 0, &higher_priority_task_woken);
+    }
+    if (done) {
+        done(ok, user_data);
+    }
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+// Claim the DMA channels and the interrupt of the bus, once
+static void i2c_bus_init(void) {
+    if (i2c_bus_tx_channel >= 0) {
+        return;
+    }
+    critical_section_init(&i2c_bus_lock);
+    i2c_nostop_mutex = xSemaphoreCreateMutex();
+    i2c_hw_t *hw = i2c_get_hw(i2c_default);
+
+    // Data commands to the TX FIFO, 16 bits each
+    i2c_bus_tx_channel = dma_claim_unused_channel(true);
+    dma_channel_config cfg = dma_channel_get_default_config(i2c_bus_tx_channel);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, i2c_get_dreq(i2c_default, true));
+    dma_channel_configure(i2c_bus_tx_channel, &cfg, &hw->data_cmd, i2c_bus_words, 0, false);
+
+    // Bytes read from the RX FIFO to the buffer of the transaction
+    i2c_bus_rx_channel = dma_claim_unused_channel(true);
+    cfg = dma_channel_get_default_config(i2c_bus_rx_channel);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_dreq(&cfg, i2c_get_dreq(i2c_default, false));
+    dma_channel_configure(i2c_bus_rx_channel, &cfg, NULL, &hw->data_cmd, 0, false);
+
+    hw->intr_mask = 0;
+    uint irq = I2C0_IRQ + i2c_hw_index(i2c_default);
+    irq_set_exclusive_handler(irq, i2c_bus_irq);
+    irq_set_enabled(irq, true);
+}
+
 // Initialize I2C peripheral
 void init_i2c(uint sda_pin, uint scl_pin) {
-    i2c_init(i2c_default, 400*1000);
+    i2c_init(i2c_default, I2C_BUS_BAUDRATE);
     gpio_set_function(sda_pin, GPIO_FUNC_I2C);
     gpio_set_function(scl_pin, GPIO_FUNC_I2C);
     gpio_pull_up(sda_pin);
     gpio_pull_up(scl_pin);
+    i2c_bus_init();
 }
 
 void init_i2c_default(){
     init_i2c(DEFAULT_I2C_SDA_PIN, DEFAULT_I2C_SCL_PIN);
 }
 
+bool i2c_bus_submit(i2c_bus_transfer_t *transfer) {
+    if (transfer == NULL || transfer->busy || i2c_bus_tx_channel < 0 ||
+        transfer->priority >= I2C_BUS_PRIORITIES ||
+        transfer->tx_len + transfer->rx_len == 0 ||
+        transfer->tx_len + transfer->rx_len > I2C_BUS_MAX_TRANSFER) {
+        return false;
+    }
+    transfer->next = NULL;
+    transfer->ok = false;
+    transfer->busy = true;
+
+    critical_section_enter_blocking(&i2c_bus_lock);
+    uint8_t priority = transfer->priority;
+    if (i2c_bus_tail[priority] != NULL) {
+        i2c_bus_tail[priority]->next = transfer;
+    } else {
+        i2c_bus_head[priority] = transfer;
+    }
+    i2c_bus_tail[priority] = transfer;
+    i2c_bus_start_next();
+    critical_section_exit(&i2c_bus_lock);
+    if (i2c_bus_stop_pending && __get_current_exception() == 0) {
+        i2c_bus_recover();
+    }
+    return true;
+}
+
+// The calling task can block (otherwise only the init code runs, before the scheduler)
+static bool i2c_bus_can_block(void) {
+    return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+// End of a blocking transfer, in the I2C interrupt: wake its task
+static void i2c_bus_wake_task(bool ok, void *user_data) {
+    (void)ok;
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveIndexedFromISR((TaskHandle_t)user_data, I2C_BUS_NOTIFY_INDEX, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+bool i2c_bus_transfer(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                      uint8_t *rx, size_t rx_len, uint8_t priority) {
+    bool can_block = i2c_bus_can_block();
+    i2c_bus_transfer_t transfer = {
+        .addr = addr,
+        .priority = priority,
+        .tx = tx,
+        .tx_len = tx_len,
+        .rx = rx,
+        .rx_len = rx_len,
+        .done = can_block ? i2c_bus_wake_task : NULL,
+        .user_data = can_block ? xTaskGetCurrentTaskHandle() : NULL,
+    };
+    if (!i2c_bus_submit(&transfer)) {
+        return false;
+    }
+    while (transfer.busy) {
+        if (can_block) {
+            // A notification left by an earlier transfer that ended after its busy check only loops once more
+            ulTaskNotifyTakeIndexed(I2C_BUS_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+        } else {
+            i2c_bus_recover();
+            tight_loop_contents();
+        }
+    }
+    return transfer.ok;
+}
+
+// The caller kept a write with nostop
+static bool i2c_nostop_owned(void) {
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        // Only the init code runs, it owns the kept write
+        return i2c_nostop_len > 0;
+    }
+    return xSemaphoreGetMutexHolder(i2c_nostop_mutex) == xTaskGetCurrentTaskHandle();
+}
+
+static void i2c_nostop_take(void) {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+        xSemaphoreTake(i2c_nostop_mutex, portMAX_DELAY);
+    }
+}
+
+static void i2c_nostop_give(void) {
+    i2c_nostop_len = 0;
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+        xSemaphoreGive(i2c_nostop_mutex);
+    }
+}
+
+// Send the caller's kept write that no read followed, on its own
+static void i2c_send_nostop_write(void) {
+    i2c_bus_transfer(i2c_nostop_addr, i2c_nostop_data, i2c_nostop_len, NULL, 0, I2C_BUS_PRIORITY_NORMAL);
+    i2c_nostop_give();
+}
+
 // Generic I2C write function
 bool i2c_write(uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
-    int bytes_written = i2c_write_blocking(i2c_default, addr, src, len, nostop);
-    return bytes_written == (int)len;
+    if (i2c_nostop_owned()) {
+        i2c_send_nostop_write();
+    }
+    if (nostop) {
+        if (len == 0 || len > I2C_NOSTOP_WRITE_MAX) {
+            return false;
+        }
+        i2c_nostop_take();
+        memcpy(i2c_nostop_data, src, len);
+        i2c_nostop_len = len;
+        i2c_nostop_addr = addr;
+        return true;
+    }
+    return i2c_bus_transfer(addr, src, len, NULL, 0, I2C_BUS_PRIORITY_NORMAL);
 }
 
 // Generic I2C read function
 bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
-    int bytes_read = i2c_read_blocking(i2c_default, addr, dst, len, nostop);
-    return bytes_read == (int)len;
+    (void)nostop;
+    if (!i2c_nostop_owned()) {
+        return i2c_bus_transfer(addr, NULL, 0, dst, len, I2C_BUS_PRIORITY_NORMAL);
+    }
+    if (i2c_nostop_addr != addr) {
+        i2c_send_nostop_write();
+        return i2c_bus_transfer(addr, NULL, 0, dst, len, I2C_BUS_PRIORITY_NORMAL);
+    }
+    bool ok = i2c_bus_transfer(addr, i2c_nostop_data, i2c_nostop_len, dst, len, I2C_BUS_PRIORITY_NORMAL);
+    i2c_nostop_give();
+    return ok;
 }
 
 /* =========================
@@ -329,10 +855,86 @@ int get_microphone_samples(int16_t* buffer, size_t samples) {
 // Library used can be found at: https://github.com/daschr/pico-ssd1306https://github.com/daschr/pico-ssd1306
  static ssd1306_t disp;
 
+// Transactions of the flush on the wire, queued behind the sensor reads
+static i2c_bus_transfer_t display_transfers[SSD1306_MAX_TRANSACTIONS];
+// Transactions of the flush not ended yet, plus one held by display_flush_async() while it queues them: the one that
+// brings it to 0 ends the flush
+static uint8_t display_transfers_left = 0;
+// Shared by display_flush_async() and the I2C interrupt
+static critical_section_t display_lock;
+static volatile bool display_flushing = false;
+static volatile bool display_flush_ok;
+static display_done_callback_t display_done;
+static void *display_done_data;
+// Given at the end of each flush, the tasks in display_wait() block on it
+static SemaphoreHandle_t display_idle = NULL;
+
+static bool display_bus_write(uint8_t address, const uint8_t *src, size_t len) {
+    return i2c_bus_transfer(address, src, len, NULL, 0, I2C_BUS_PRIORITY_LOW);
+}
+
+// One transaction of the flush less to wait for, true when it was the last one
+static bool display_transfer_ended(void) {
+    critical_section_enter_blocking(&display_lock);
+    bool last = --display_transfers_left == 0;
+    critical_section_exit(&display_lock);
+    return last;
+}
+
+// End of the flush: wake the tasks in display_wait() and call the callback. From the I2C interrupt when
+// higher_priority_task_woken is set, from display_flush_async() when it is NULL.
+static void display_flush_end(BaseType_t *higher_priority_task_woken) {
+    if (!display_flush_ok) {
+        // The display ram is unknown: the next flush sends the whole frame
+        ssd1306_invalidate(&disp);
+    }
+    display_flushing = false;
+    if (display_idle != NULL) {
+        if (higher_priority_task_woken != NULL) {
+            xSemaphoreGiveFromISR(display_idle, higher_priority_task_woken);
+        } else {
+            xSemaphoreGive(display_idle);
+        }
+    }
+    if (display_done) {
+        display_done(display_flush_ok, display_done_data);
+    }
+}
+
+// End of one transaction of the flush, in the I2C interrupt: the last one ends the flush
+static void display_transfer_done(bool ok, void *user_data) {
+    (void)user_data;
+    if (!ok) {
+        display_flush_ok = false;
+    }
+    if (!display_transfer_ended()) {
+        return;
+    }
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    display_flush_end(&higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static_assert(SSD1306_UPDATE_CHUNK + 1 <= I2C_BUS_MAX_TRANSFER, "a display transaction must fit the bus service");
+// Line of write_text: font scale 2 at y=24, the pages 3 and 4
+#define DISPLAY_TEXT_SCALE 2
+#define DISPLAY_TEXT_PAGE 3
+
 // Display-related functions
  void init_display() {
+    // Initialized again after stop_display: release the last buffers first
+    if (disp.bufsize != 0) {
+        display_wait();
+        ssd1306_deinit(&disp);
+    }
+    if (display_idle == NULL) {
+        display_idle = xSemaphoreCreateBinary();
+        critical_section_init(&display_lock);
+    }
     // Initialize the SSD1306 display with external VCC
     disp.external_vcc = false;
+    // The commands go through the bus queue like the frames
+    disp.write = display_bus_write;
     ssd1306_init(&disp, 128, 64, SSD1306_I2C_ADDRESS, i2c_default);
 
     //power it on
@@ -353,10 +955,7 @@ void write_text_xy(int16_t x0, int16_t y0, const char *text) {
     const uint8_t scale = 1; //Default font scale is 1
 
     ssd1306_draw_string(&disp, (uint32_t)x0, (uint32_t)y0, scale, text);
-    ssd1306_show(&disp);
-
-    // Delay for 800 milliseconds
-    sleep_ms(800);
+    display_flush_async(NULL, NULL);
 }
 
 void write_text(const char *text) {
@@ -364,13 +963,22 @@ void write_text(const char *text) {
     if (!text)return;
 
     // Draw the text at the specified position with a font size of 2
-    ssd1306_draw_string(&disp, 8, 24, 2, text);
+    ssd1306_draw_string(&disp, 8, DISPLAY_TEXT_PAGE * 8, DISPLAY_TEXT_SCALE, text);
 
     // Update the display
-    ssd1306_show(&disp);
+    display_flush_async(NULL, NULL);
+}
+
+void write_text_scroll(const char *text, int32_t offset) {
+    if (!text) return;
+
+    // Only the text line is drawn again: the flush sends its 2 pages, not the whole frame
+    ssd1306_draw_string_window(&disp, DISPLAY_TEXT_PAGE, DISPLAY_TEXT_SCALE, text, offset);
+    display_flush_async(NULL, NULL);
+}
 
-    // Delay for 800 milliseconds
-    sleep_ms(800);
+uint32_t text_width(const char *text) {
+    return text ? ssd1306_string_width(DISPLAY_TEXT_SCALE, text) : 0;
 }
 
 /**
@@ -429,7 +1037,7 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
         return;
     if (r == 0) { 
         putp(x0, y0); 
-        ssd1306_show(&disp); 
+        display_flush_async(NULL, NULL); 
         return; 
     }
 
@@ -469,7 +1077,7 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
             putp((int16_t)(x0 - y), (int16_t)(y0 - x));
         }
     }
-    ssd1306_show(&disp);  // remove if batching multiple draws
+    display_flush_async(NULL, NULL);  // remove if batching multiple draws
 }
 
  void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1) {
@@ -477,7 +1085,7 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
     ssd1306_draw_line(&disp, x0, y0, x1, y1);
 
     // Update the display
-    ssd1306_show(&disp);
+    display_flush_async(NULL, NULL);
 }
 
  void draw_square(uint32_t x, uint32_t y, uint32_t w, uint32_t h, bool fill) {
@@ -488,20 +1096,84 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
         ssd1306_draw_empty_square(&disp, x, y, w, h);
 
     // Update the display
-    ssd1306_show(&disp);
+    display_flush_async(NULL, NULL);
 }
 
 void clear_display() {
     // Clear the display
     ssd1306_clear(&disp);
     // Update the display
-    ssd1306_show(&disp);
+    display_flush_async(NULL, NULL);
 }
 
 void stop_display() {
+    display_wait();
     ssd1306_poweroff(&disp);
 }
 
+bool display_flush_async(display_done_callback_t done, void *user_data) {
+    // One frame on the wire at a time: wait for the last one, the drawing itself never waits
+    display_wait();
+    if (!ssd1306_prepare_update(&disp)) {
+        if (done) {
+            done(true, user_data);
+        }
+        return true;
+    }
+
+    display_done = done;
+    display_done_data = user_data;
+    display_flush_ok = true;
+    display_transfers_left = 1;
+    display_flushing = true;
+    bool queued = true;
+    for (uint8_t i = 0; i < disp.txcount; i++) {
+        i2c_bus_transfer_t *t = &display_transfers[i];
+        t->addr = disp.address;
+        t->priority = I2C_BUS_PRIORITY_LOW;
+        t->tx = disp.txbuf + disp.tx[i].offset;
+        t->tx_len = disp.tx[i].len;
+        t->rx = NULL;
+        t->rx_len = 0;
+        t->done = display_transfer_done;
+        t->user_data = t;
+        critical_section_enter_blocking(&display_lock);
+        display_transfers_left++;
+        critical_section_exit(&display_lock);
+        if (!i2c_bus_submit(t)) {
+            // Not queued (the bus is not initialized): the flush ends with the transactions already queued
+            display_transfer_ended();
+            display_flush_ok = false;
+            queued = false;
+            break;
+        }
+    }
+    if (display_transfer_ended()) {
+        // Every transaction already ended, or none was queued
+        display_flush_end(NULL);
+    }
+    return queued;
+}
+
+bool display_is_busy() {
+    return display_flushing;
+}
+
+void display_wait() {
+    if (display_idle == NULL || !i2c_bus_can_block()) {
+        while (display_is_busy()) {
+            tight_loop_contents();
+        }
+        return;
+    }
+    // A full frame is about 25 ms at 400 kHz, the task sleeps until the last transaction is on the wire
+    while (display_is_busy()) {
+        xSemaphoreTake(display_idle, portMAX_DELAY);
+    }
+    // The end of a flush gives the semaphore once: pass it on to the next waiting task
+    xSemaphoreGive(display_idle);
+}
+
 
 /* =========================
  *  LIGHT SENSOR VEML6030
@@ -525,7 +1197,7 @@ void init_veml6030() {
     };
     
     // Write configuration to sensor
-    i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, config, sizeof(config), false);
+    i2c_bus_transfer(VEML6030_I2C_ADDR, config, sizeof(config), NULL, 0, I2C_BUS_PRIORITY_NORMAL);
     sleep_ms(10);
 }
 
@@ -564,17 +1236,16 @@ uint32_t veml6030_read_light() {
 
     uint32_t luxVal_uncorrected = 0; 
 
-        if(i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR , txBuffer, 1, true) != PICO_ERROR_GENERIC) {
-            if(i2c_read_blocking(i2c_default, VEML6030_I2C_ADDR, rxBuffer, 2, false) != PICO_ERROR_GENERIC) {                
-                // Changing the 2-byte data in rxBuffer
-                // into a temperature value (formula in exercise material)
-                //PART OF THE LAB SESSION.
-                uint16_t raw = ((uint16_t) rxBuffer[1] << 8) | rxBuffer[0];
-                luxVal_uncorrected = raw * 0.5376;
+        // Register address and value in one transaction (repeated start)
+        if(i2c_bus_transfer(VEML6030_I2C_ADDR, txBuffer, 1, rxBuffer, 2, I2C_BUS_PRIORITY_NORMAL)) {
+            // Changing the 2-byte data in rxBuffer
+            // into a temperature value (formula in exercise material)
+            //PART OF THE LAB SESSION.
+            uint16_t raw = ((uint16_t) rxBuffer[1] << 8) | rxBuffer[0];
+            luxVal_uncorrected = raw * 0.5376;
 
-                // Temperature value to console window
-                //printf("%f", luxVal_uncorrected);
-            }
+            // Temperature value to console window
+            //printf("%f", luxVal_uncorrected);
         }
         else {
             printf("I2C Bus fault\n");
@@ -597,10 +1268,8 @@ uint32_t veml6030_read_light() {
 static uint16_t _veml6030_read_register(uint8_t reg) {
     uint8_t data[2] = {0,0};
 
-    // Select ALS output register
-    i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, &reg, 1, true);
-    // Read two bytes (MSB first)
-    i2c_read_blocking(i2c_default, VEML6030_I2C_ADDR, data, sizeof(data), false);
+    // Select ALS output register and read two bytes (MSB first)
+    i2c_bus_transfer(VEML6030_I2C_ADDR, &reg, 1, data, sizeof(data), I2C_BUS_PRIORITY_NORMAL);
     //data [0] contains the LSB and data[1] the MSB
     return ((uint16_t)data[0]) |((uint16_t) data[1]<<8);
 }
@@ -613,7 +1282,7 @@ void veml6030_stop(){
     };
     
     // Write configuration to sensor
-    i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, config, sizeof(config), false);
+    i2c_bus_transfer(VEML6030_I2C_ADDR, config, sizeof(config), NULL, 0, I2C_BUS_PRIORITY_NORMAL);
     sleep_ms(10);
 }
 
@@ -628,9 +1297,8 @@ void veml6030_stop(){
 // https://www.ti.com/lit/ug/snau250/snau250.pdf?ts=1757438909914
 
  static int8_t read_hdc2021_register(uint8_t reg) {
-    uint8_t data;
-    i2c_write(HDC2021_I2C_ADDRESS, &reg, 1, true);
-    i2c_read(HDC2021_I2C_ADDRESS, &data, 1, false);
+    uint8_t data = 0;
+    i2c_bus_transfer(HDC2021_I2C_ADDRESS, &reg, 1, &data, 1, I2C_BUS_PRIORITY_NORMAL);
     return data;
 }
 
@@ -716,10 +1384,9 @@ void hdc2021_set_low_humidity_threshold(float humid) {
 // Note that sampling rate is 1Hz
 float hdc2021_read_temperature() {
     uint8_t reg = HDC2021_TEMP_LOW;
-    uint8_t data[2];
+    uint8_t data[2] = {0, 0};
     
-    i2c_write(HDC2021_I2C_ADDRESS, &reg, 1, true);
-    i2c_read(HDC2021_I2C_ADDRESS, data, 2, false);
+    i2c_bus_transfer(HDC2021_I2C_ADDRESS, &reg, 1, data, 2, I2C_BUS_PRIORITY_NORMAL);
     uint16_t raw = ((uint16_t) data[1] << 8) | data[0];
     return (raw * 165.0f / 65536.0f) - 40.0f;
 }
@@ -727,10 +1394,9 @@ float hdc2021_read_temperature() {
 //Note that sampling rate is 1 HX
 float hdc2021_read_humidity() {
     uint8_t reg = HDC2021_HUMIDITY_LOW;
-    uint8_t data[2];
+    uint8_t data[2] = {0, 0};
     
-    i2c_write(HDC2021_I2C_ADDRESS, &reg, 1, true);
-    i2c_read(HDC2021_I2C_ADDRESS, data, 2, false);
+    i2c_bus_transfer(HDC2021_I2C_ADDRESS, &reg, 1, data, 2, I2C_BUS_PRIORITY_NORMAL);
     
     uint16_t raw = ((uint16_t) data[1] << 8) | data[0];
     return (raw * 100.0f / 65536.0f);
@@ -758,28 +1424,27 @@ void stop_hdc2021() {
 // https://invensense.tdk.com/wp-content/uploads/2021/07/DS-000451-ICM-42670-P-v1.0.pdf
 
 float aRes, gRes;      // scale resolutions per LSB for the sensors
+static icm42670_scale_t icm_scale; // same resolutions as integers, for the raw read path
+// Configuration given to startAccel/startGyro, restored when leaving wake-on-motion
+static uint16_t icm_accel_odr_hz, icm_accel_fsr_g, icm_gyro_odr_hz, icm_gyro_fsr_dps;
+static bool icm_wom_enabled = false;
 
+// The IMU goes first on the bus: its reads wait for one transaction at most, not for a display frame
 static int icm_i2c_write_byte(uint8_t reg, uint8_t value) {
     uint8_t buf[2] = { reg, value };
     //printf("Before writing to i2c reg:0x%x, val:0x%x\n", reg, value);
-    int result = i2c_write_blocking(i2c_default, ICM42670_I2C_ADDRESS, buf, 2, false);
-    //printf("After writing to i2c. Result: %d\n",result);
-    return result == 2 ? 0 : -1;
+    bool ok = i2c_bus_transfer(ICM42670_I2C_ADDRESS, buf, 2, NULL, 0, I2C_BUS_PRIORITY_HIGH);
+    //printf("After writing to i2c. Result: %d\n",ok);
+    return ok ? 0 : -1;
 }
 
 // helper to read a byte from a register
 static int icm_i2c_read_byte(uint8_t reg, uint8_t *value) {
-    int result = i2c_write_blocking(i2c_default, ICM42670_I2C_ADDRESS, &reg, 1, true);
-    if (result != 1) return -1;
-    result = i2c_read_blocking(i2c_default, ICM42670_I2C_ADDRESS, value, 1, false);
-    return result == 1 ? 0 : -1;
+    return i2c_bus_transfer(ICM42670_I2C_ADDRESS, &reg, 1, value, 1, I2C_BUS_PRIORITY_HIGH) ? 0 : -1;
 }
 
 static int icm_i2c_read_bytes(uint8_t reg, uint8_t *buffer, uint8_t len) {
-    int result = i2c_write_blocking(i2c_default, ICM42670_I2C_ADDRESS, &reg, 1, true);
-    if (result != 1) return -1;
-    result = i2c_read_blocking(i2c_default, ICM42670_I2C_ADDRESS, buffer, len, false);
-    return result == len ? 0 : -2;
+    return i2c_bus_transfer(ICM42670_I2C_ADDRESS, &reg, 1, buffer, len, I2C_BUS_PRIORITY_HIGH) ? 0 : -2;
 }
 
 static int icm_soft_reset(void) {
@@ -809,8 +1474,7 @@ static int ICM42670_autodetect_address(void) {
         int hits = 0;
         for (int t = 0; t < 4; ++t) {
             uint8_t who = 0, reg = ICM42670_REG_WHO_AM_I;
-            if (i2c_write_blocking(i2c_default, cand[i], &reg, 1, true) != 1) continue;
-            if (i2c_read_blocking(i2c_default, cand[i], &who, 1, false) != 1) continue;
+            if (!i2c_bus_transfer(cand[i], &reg, 1, &who, 1, I2C_BUS_PRIORITY_HIGH)) continue;
             if (who == ICM42670_WHO_AM_I_RESPONSE) ++hits;
         }
         if (hits >= 3) { return cand[i]; } // majority wins
@@ -818,14 +1482,44 @@ static int ICM42670_autodetect_address(void) {
     return -1;
 }
 
-//TODO do initial calibration. 
-static void calibrateAccel(float *dest1){
+/* -------- Offsets (startup calibration) -------- */
 
-}
+static icm42670_offsets_t icm_offsets;  // as measured, in the ranges of icm_offsets.scale
+static bool icm_offsets_valid = false;
+// Offsets in the current ranges, subtracted while the samples are unpacked
+static int16_t icm_accel_bias[3];
+static int16_t icm_gyro_bias[3];
+static int8_t icm_bias_temperature;     // FIFO temperature icm_gyro_bias was computed for
 
-static void calibrateGyro(float *dest2){
+static inline int16_t icm_subtract_sat(int16_t value, int16_t bias) {
+    int32_t v = (int32_t)value - bias;
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
 
+static void icm_update_gyro_bias(int8_t temperature) {
+    icm_bias_temperature = temperature;
+    int32_t delta = temperature - icm_offsets.temperature;
+    for (int axis = 0; axis < 3; ++axis) {
+        int32_t bias = icm_offsets.gyro[axis] + ((int32_t)icm_offsets.gyro_tc_q8[axis] * delta) / 256;
+        icm_gyro_bias[axis] = (int16_t)(bias * icm_scale.gyro_lsb_per_dps_x10 /
+                                        icm_offsets.scale.gyro_lsb_per_dps_x10);
+    }
+}
 
+// Recompute the biases after the offsets or the full-scale ranges changed
+static void icm_apply_offsets(void) {
+    if (!icm_offsets_valid) {
+        for (int axis = 0; axis < 3; ++axis) {
+            icm_accel_bias[axis] = 0;
+            icm_gyro_bias[axis] = 0;
+        }
+        return;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        icm_accel_bias[axis] = (int16_t)((int32_t)icm_offsets.accel[axis] * icm_scale.accel_lsb_per_g /
+                                         icm_offsets.scale.accel_lsb_per_g);
+    }
+    icm_update_gyro_bias(icm_offsets.temperature);
 }
 
 int init_ICM42670() {
@@ -872,18 +1566,22 @@ int ICM42670_startAccel(uint16_t odr_hz, uint16_t fsr_g) {
         case 2:  
             fsr_bits = ICM42670_ACCEL_FSR_2G;
             aRes = 16384; 
+            icm_scale.accel_lsb_per_g = 16384;
             break;
         case 4:  
             fsr_bits = ICM42670_ACCEL_FSR_4G;
             aRes = 8192;
+            icm_scale.accel_lsb_per_g = 8192;
             break;
         case 8:  
             fsr_bits = ICM42670_ACCEL_FSR_8G; 
             aRes =4096;
+            icm_scale.accel_lsb_per_g = 4096;
             break;
         case 16: 
             fsr_bits = ICM42670_ACCEL_FSR_16G;
             aRes = 2048;
+            icm_scale.accel_lsb_per_g = 2048;
             break;
         default: return -1; // invalid FSR
     }
@@ -905,6 +1603,9 @@ int ICM42670_startAccel(uint16_t odr_hz, uint16_t fsr_g) {
     int rc = icm_i2c_write_byte(ICM42670_ACCEL_CONFIG0_REG, accel_config0_val);
     busy_wait_us(400); 
     if (rc != 0) return -3;
+    icm_accel_odr_hz = odr_hz;
+    icm_accel_fsr_g = fsr_g;
+    icm_apply_offsets(); // offsets follow the new range
     return 0; // success
 }
 
@@ -917,18 +1618,22 @@ int ICM42670_startGyro(uint16_t odr_hz, uint16_t fsr_dps) {
         case 250:  
             fsr_bits = 0x03;
             gRes = 131; 
+            icm_scale.gyro_lsb_per_dps_x10 = 1310;
             break;
         case 500:  
             fsr_bits = 0x02;
             gRes = 65.5;
+            icm_scale.gyro_lsb_per_dps_x10 = 655;
             break;
         case 1000: 
             fsr_bits = 0x01;
             gRes = 32.8;
+            icm_scale.gyro_lsb_per_dps_x10 = 328;
             break;
         case 2000: 
             fsr_bits = 0x00;
             gRes = 16.4;
+            icm_scale.gyro_lsb_per_dps_x10 = 164;
             break;
         default:   return -1;
     }
@@ -949,6 +1654,9 @@ int ICM42670_startGyro(uint16_t odr_hz, uint16_t fsr_dps) {
     uint8_t gyro_config0_val = (fsr_bits << 5) | (odr_bits & 0x0F);
     if (icm_i2c_write_byte(ICM42670_GYRO_CONFIG0_REG, gyro_config0_val) != 0) return -3;
     busy_wait_us(400); 
+    icm_gyro_odr_hz = odr_hz;
+    icm_gyro_fsr_dps = fsr_dps;
+    icm_apply_offsets(); // offsets follow the new range
     return 0;
 }
 
@@ -999,30 +1707,384 @@ int ICM42670_start_with_default_values(void) {
 }
 
 
-int ICM42670_read_sensor_data(float *ax, float *ay, float *az,
-    float *gx, float *gy, float *gz,float *t) {
-        
+int ICM42670_read_raw(icm42670_raw_data_t *data, icm42670_scale_t *scale) {
         uint8_t raw[14]; // 14 bytes total from TEMP to GYRO Z
 
         int rc = icm_i2c_read_bytes(ICM42670_SENSOR_DATA_START_REG, raw, sizeof(raw));
         if (rc != 0) return rc;
 
         // Convert to signed 16-bit integers (big-endian)
-        int16_t t_raw = (int16_t)((raw[0] << 8) | raw[1]);
-        int16_t ax_raw = ((int16_t)raw[2] << 8) | raw[3];
-        int16_t ay_raw = ((int16_t)raw[4] << 8) | raw[5];
-        int16_t az_raw = ((int16_t)raw[6] << 8) | raw[7];
-        int16_t gx_raw = (int16_t)((raw[8] << 8) | raw[9]);
-        int16_t gy_raw = (int16_t)((raw[10] << 8) | raw[11]);
-        int16_t gz_raw = (int16_t)((raw[12] << 8) | raw[13]);
-
-        *t = ((float)t_raw / 128.0f)+ 25.0;
-        *ax =  (float)ax_raw / aRes; 
-        *ay =  (float)ay_raw / aRes; 
-        *az =  (float)az_raw / aRes;
-        *gx =  (float)gx_raw / gRes; 
-        *gy =  (float)gy_raw / gRes; 
-        *gz =  (float)gz_raw / gRes;
+        data->temperature = (int16_t)((raw[0] << 8) | raw[1]);
+        // Register temperature is 1/128 °C, the offsets follow the 0.5 °C FIFO steps
+        int8_t temperature = (int8_t)(data->temperature >> 6);
+        if (icm_offsets_valid && temperature != icm_bias_temperature) icm_update_gyro_bias(temperature);
+        for (int axis = 0; axis < 3; ++axis) {
+            data->accel[axis] = icm_subtract_sat((int16_t)((raw[2 + 2 * axis] << 8) | raw[3 + 2 * axis]), icm_accel_bias[axis]);
+            data->gyro[axis]  = icm_subtract_sat((int16_t)((raw[8 + 2 * axis] << 8) | raw[9 + 2 * axis]), icm_gyro_bias[axis]);
+        }
+        if (scale) *scale = icm_scale;
+        return 0; // success
+}
+
+void ICM42670_get_scale(icm42670_scale_t *scale) {
+    *scale = icm_scale;
+}
+
+int32_t ICM42670_accel_mg_to_raw(const icm42670_scale_t *scale, int32_t mg) {
+    return mg * (int32_t)scale->accel_lsb_per_g / 1000;
+}
+
+int32_t ICM42670_gyro_dps_to_raw(const icm42670_scale_t *scale, int32_t dps) {
+    return dps * (int32_t)scale->gyro_lsb_per_dps_x10 / 10;
+}
+
+int ICM42670_read_sensor_data(float *ax, float *ay, float *az,
+    float *gx, float *gy, float *gz,float *t) {
+
+        icm42670_raw_data_t raw;
+        int rc = ICM42670_read_raw(&raw, NULL);
+        if (rc != 0) return rc;
+
+        *t = ((float)raw.temperature / 128.0f)+ 25.0;
+        *ax =  (float)raw.accel[0] / aRes; 
+        *ay =  (float)raw.accel[1] / aRes; 
+        *az =  (float)raw.accel[2] / aRes;
+        *gx =  (float)raw.gyro[0] / gRes; 
+        *gy =  (float)raw.gyro[1] / gRes; 
+        *gz =  (float)raw.gyro[2] / gRes;
         return 0; // success
 }
 
+/* -------- FIFO streaming -------- */
+
+// Count (2 bytes) followed by the packets, read in the same transaction
+static uint8_t icm_fifo_buffer[2 + ICM42670_FIFO_MAX_BURST * ICM42670_FIFO_PACKET_SIZE];
+static_assert(1 + sizeof(icm_fifo_buffer) <= I2C_BUS_MAX_TRANSFER, "a FIFO burst must fit one bus transaction");
+
+// MREG1 registers are written indirectly through BLK_SEL_W / MADDR_W / M_W
+static int icm_mreg1_write_byte(uint8_t reg, uint8_t value) {
+    if (icm_i2c_write_byte(ICM42670_BLK_SEL_W_REG, 0x00) != 0) return -1;
+    if (icm_i2c_write_byte(ICM42670_MADDR_W_REG, reg) != 0) return -1;
+    if (icm_i2c_write_byte(ICM42670_M_W_REG, value) != 0) return -1;
+    busy_wait_us(10);   // datasheet: wait 10 µs before the next MREG access
+    return 0;
+}
+
+static int icm_i2c_update_bits(uint8_t reg, uint8_t mask, uint8_t value) {
+    uint8_t v = 0;
+    if (icm_i2c_read_byte(reg, &v) != 0) return -1;
+    v = (v & ~mask) | (value & mask);
+    return icm_i2c_write_byte(reg, v);
+}
+
+int ICM42670_fifo_flush(void) {
+    if (icm_i2c_write_byte(ICM42670_REG_SIGNAL_PATH_RESET, ICM42670_FIFO_FLUSH) != 0) return -1;
+    busy_wait_us(2);    // flush takes 1.5 µs
+    return 0;
+}
+
+int ICM42670_fifo_enable(uint16_t watermark) {
+    if (watermark == 0 || watermark > ICM42670_FIFO_MAX_BURST) return -1;
+
+    // Keep the FIFO bypassed while it is configured
+    if (icm_i2c_write_byte(ICM42670_FIFO_CONFIG1_REG, ICM42670_FIFO_BYPASS) != 0) return -2;
+    // Count (and watermark) in packets, so a count maps directly to a burst length
+    if (icm_i2c_update_bits(ICM42670_INTF_CONFIG0_REG, ICM42670_FIFO_COUNT_RECORDS,
+                            ICM42670_FIFO_COUNT_RECORDS) != 0) return -3;
+    // Store accel + gyro -> 16 byte packets with temperature and timestamp
+    if (icm_mreg1_write_byte(ICM42670_MREG1_FIFO_CONFIG5,
+                             ICM42670_FIFO_ACCEL_EN | ICM42670_FIFO_GYRO_EN) != 0) return -4;
+    if (icm_i2c_write_byte(ICM42670_FIFO_CONFIG2_REG, watermark & 0xFF) != 0) return -5;
+    if (icm_i2c_write_byte(ICM42670_FIFO_CONFIG3_REG, (watermark >> 8) & 0x0F) != 0) return -5;
+    // Route the watermark interrupt to INT1
+    if (icm_i2c_update_bits(ICM42670_INT_SOURCE0_REG, ICM42670_FIFO_THS_INT1_EN,
+                            ICM42670_FIFO_THS_INT1_EN) != 0) return -6;
+    // Stream mode: the oldest packets are overwritten when the FIFO is full
+    if (icm_i2c_write_byte(ICM42670_FIFO_CONFIG1_REG, 0x00) != 0) return -7;
+    busy_wait_us(200);
+    return ICM42670_fifo_flush();
+}
+
+int ICM42670_fifo_disable(void) {
+    if (icm_i2c_update_bits(ICM42670_INT_SOURCE0_REG, ICM42670_FIFO_THS_INT1_EN, 0) != 0) return -1;
+    if (icm_i2c_write_byte(ICM42670_FIFO_CONFIG1_REG, ICM42670_FIFO_BYPASS) != 0) return -2;
+    return ICM42670_fifo_flush();
+}
+
+int ICM42670_fifo_count(uint16_t *count) {
+    uint8_t raw[2];
+    int rc = icm_i2c_read_bytes(ICM42670_FIFO_COUNTH_REG, raw, sizeof(raw));
+    if (rc != 0) return rc;
+    *count = (uint16_t)((raw[0] << 8) | raw[1]);
+    return 0;
+}
+
+int ICM42670_fifo_read(icm42670_fifo_packet_t *packets, size_t max_packets,
+                       uint16_t *remaining) {
+    if (max_packets == 0 || max_packets > ICM42670_FIFO_MAX_BURST) return -1;
+
+    // FIFO_COUNTH, FIFO_COUNTL and FIFO_DATA are consecutive: the address stops
+    // incrementing at FIFO_DATA, so one read returns the count and the packets.
+    size_t len = 2 + max_packets * ICM42670_FIFO_PACKET_SIZE;
+    uint8_t reg = ICM42670_FIFO_COUNTH_REG;
+    if (!i2c_bus_transfer(ICM42670_I2C_ADDRESS, &reg, 1, icm_fifo_buffer, len, I2C_BUS_PRIORITY_HIGH)) return -2;
+
+    uint16_t count = (uint16_t)((icm_fifo_buffer[0] << 8) | icm_fifo_buffer[1]);
+    size_t n = 0;
+    size_t popped = 0;
+    // The count is latched at the start of the burst, packets stored meanwhile are read (and popped) too:
+    // decode up to the first empty packet, whatever the count said
+    for (; popped < max_packets; ++popped) {
+        const uint8_t *p = &icm_fifo_buffer[2 + popped * ICM42670_FIFO_PACKET_SIZE];
+        if (p[0] & ICM42670_FIFO_HEADER_EMPTY) break;
+        if ((p[0] & (ICM42670_FIFO_HEADER_ACCEL | ICM42670_FIFO_HEADER_GYRO)) !=
+            (ICM42670_FIFO_HEADER_ACCEL | ICM42670_FIFO_HEADER_GYRO)) continue;
+
+        icm42670_fifo_packet_t *out = &packets[n++];
+        out->temperature = (int8_t)p[13];
+        // The gyroscope offset is only recomputed when the temperature changed
+        if (icm_offsets_valid && out->temperature != icm_bias_temperature) icm_update_gyro_bias(out->temperature);
+        for (int axis = 0; axis < 3; ++axis) {
+            out->accel[axis] = icm_subtract_sat((int16_t)((p[1 + 2 * axis] << 8) | p[2 + 2 * axis]), icm_accel_bias[axis]);
+            out->gyro[axis]  = icm_subtract_sat((int16_t)((p[7 + 2 * axis] << 8) | p[8 + 2 * axis]), icm_gyro_bias[axis]);
+        }
+        out->timestamp = (uint16_t)((p[14] << 8) | p[15]);
+    }
+    if (remaining) *remaining = count > popped ? count - popped : 0;
+    return (int)n;
+}
+
+int ICM42670_enable_int1(uint8_t sources) {
+    // Push-pull, active low, pulsed
+    if (icm_i2c_write_byte(ICM42670_INT_CONFIG, ICM42670_INT1_CONFIG_VALUE) != 0) return -1;
+    busy_wait_us(200);
+    if (sources != 0 &&
+        icm_i2c_update_bits(ICM42670_INT_SOURCE0_REG, sources, sources) != 0) return -2;
+
+    gpio_init(ICM42670_INT);
+    gpio_set_dir(ICM42670_INT, GPIO_IN);
+    gpio_pull_up(ICM42670_INT);
+    return 0;
+}
+
+/* -------- Wake-on-motion -------- */
+
+int ICM42670_enable_wom(uint16_t threshold_mg, uint16_t lp_odr_hz) {
+    if (icm_accel_odr_hz == 0 || icm_gyro_odr_hz == 0) return -1;
+    uint32_t threshold = (uint32_t)threshold_mg * 100 / ICM42670_WOM_MG_PER_LSB_X100;
+    if (threshold == 0) threshold = 1;
+    if (threshold > 255) threshold = 255;
+
+    // No FIFO packets (nor their watermark pulses) while sleeping
+    if (ICM42670_fifo_disable() != 0) return -2;
+    // MREG1 is only reachable while the clock runs: write the thresholds before the low-power mode
+    if (icm_mreg1_write_byte(ICM42670_MREG1_ACCEL_WOM_X_THR, (uint8_t)threshold) != 0 ||
+        icm_mreg1_write_byte(ICM42670_MREG1_ACCEL_WOM_Y_THR, (uint8_t)threshold) != 0 ||
+        icm_mreg1_write_byte(ICM42670_MREG1_ACCEL_WOM_Z_THR, (uint8_t)threshold) != 0) return -3;
+    busy_wait_us(1000);
+    if (icm_i2c_update_bits(ICM42670_INT_SOURCE1_REG, ICM42670_WOM_XYZ_INT1_EN,
+                            ICM42670_WOM_XYZ_INT1_EN) != 0) return -4;
+
+    // Accelerometer alone, low power, at the slow rate. startAccel keeps the range and overwrites the saved ODR.
+    uint16_t accel_odr_hz = icm_accel_odr_hz;
+    if (ICM42670_startAccel(lp_odr_hz, icm_accel_fsr_g) != 0) return -5;
+    icm_accel_odr_hz = accel_odr_hz;
+    if (icm_i2c_write_byte(ICM42670_PWR_MGMT0_REG, ICM42670_ACCEL_LP_GYRO_OFF) != 0) return -6;
+    // Datasheet: let the accelerometer settle before enabling WOM, or the first comparison wakes at once
+    sleep_ms(50);
+    if (icm_i2c_write_byte(ICM42670_WOM_CONFIG_REG, ICM42670_WOM_MODE_PREVIOUS | ICM42670_WOM_EN) != 0) return -7;
+    uint8_t status;
+    icm_i2c_read_byte(ICM42670_INT_STATUS2_REG, &status);
+    icm_wom_enabled = true;
+    return 0;
+}
+
+int ICM42670_disable_wom(void) {
+    if (icm_i2c_write_byte(ICM42670_WOM_CONFIG_REG, 0x00) != 0) return -1;
+    if (icm_i2c_update_bits(ICM42670_INT_SOURCE1_REG, ICM42670_WOM_XYZ_INT1_EN, 0) != 0) return -2;
+    uint8_t status;
+    icm_i2c_read_byte(ICM42670_INT_STATUS2_REG, &status);
+    if (!icm_wom_enabled) return 0;
+    icm_wom_enabled = false;
+    // Back to the streaming configuration
+    if (ICM42670_startAccel(icm_accel_odr_hz, icm_accel_fsr_g) != 0) return -3;
+    if (ICM42670_startGyro(icm_gyro_odr_hz, icm_gyro_fsr_dps) != 0) return -4;
+    if (ICM42670_enable_accel_gyro_ln_mode() != 0) return -5;
+    return 0;
+}
+
+int ICM42670_wom_status(uint8_t *status) {
+    return icm_i2c_read_byte(ICM42670_INT_STATUS2_REG, status);
+}
+
+void ICM42670_fifo_packet_to_float(const icm42670_fifo_packet_t *packet,
+                                   float *ax, float *ay, float *az,
+                                   float *gx, float *gy, float *gz,
+                                   float *t) {
+    *ax = (float)packet->accel[0] / aRes;
+    *ay = (float)packet->accel[1] / aRes;
+    *az = (float)packet->accel[2] / aRes;
+    *gx = (float)packet->gyro[0] / gRes;
+    *gy = (float)packet->gyro[1] / gRes;
+    *gz = (float)packet->gyro[2] / gRes;
+    *t = ((float)packet->temperature / 2.0f) + 25.0f;
+}
+
+/* -------- Startup calibration -------- */
+
+// Rounded sum / count
+static int32_t icm_round_div(int32_t sum, int32_t count) {
+    return sum >= 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+}
+
+int ICM42670_calibrate(uint16_t samples, const icm42670_offsets_t *previous,
+                       icm42670_offsets_t *offsets) {
+    if (samples == 0 || samples > ICM42670_CALIB_MAX_SAMPLES) return -1;
+    if (icm_scale.accel_lsb_per_g == 0 || icm_scale.gyro_lsb_per_dps_x10 == 0) return -1;
+
+    // Measure the sensor itself, not the old offsets
+    icm_offsets_valid = false;
+    icm_apply_offsets();
+    if (ICM42670_fifo_flush() != 0) return -2;
+
+    icm42670_fifo_packet_t packets[ICM42670_FIFO_MAX_BURST];
+    int32_t sum_accel[3] = {0}, sum_gyro[3] = {0}, sum_temp = 0;
+    int16_t min_accel[3], max_accel[3], min_gyro[3], max_gyro[3];
+    uint16_t n = 0;
+    int idle_ms = 0;
+    while (n < samples) {
+        // A 2 byte count read first: the burst (up to 514 bytes on the shared bus) is only for queued packets
+        uint16_t count;
+        if (ICM42670_fifo_count(&count) != 0) return -2;
+        if (count == 0) {
+            // No packet for 1 s: the FIFO is not enabled
+            if (++idle_ms > 1000) return -3;
+            sleep_ms(1);
+            continue;
+        }
+        idle_ms = 0;
+        size_t want = samples - n < ICM42670_FIFO_MAX_BURST ? samples - n : ICM42670_FIFO_MAX_BURST;
+        if (want > count) want = count;
+        int got = ICM42670_fifo_read(packets, want, NULL);
+        if (got < 0) return -2;
+        for (int i = 0; i < got; ++i, ++n) {
+            for (int axis = 0; axis < 3; ++axis) {
+                int16_t a = packets[i].accel[axis], g = packets[i].gyro[axis];
+                sum_accel[axis] += a;
+                sum_gyro[axis] += g;
+                if (n == 0 || a < min_accel[axis]) min_accel[axis] = a;
+                if (n == 0 || a > max_accel[axis]) max_accel[axis] = a;
+                if (n == 0 || g < min_gyro[axis]) min_gyro[axis] = g;
+                if (n == 0 || g > max_gyro[axis]) max_gyro[axis] = g;
+            }
+            sum_temp += packets[i].temperature;
+        }
+    }
+
+    // The averages are only offsets if the board did not move
+    int32_t max_accel_span = ICM42670_accel_mg_to_raw(&icm_scale, ICM42670_CALIB_MAX_ACCEL_SPAN_MG);
+    int32_t max_gyro_span = ICM42670_gyro_dps_to_raw(&icm_scale, ICM42670_CALIB_MAX_GYRO_SPAN_DPS);
+    for (int axis = 0; axis < 3; ++axis) {
+        if (max_accel[axis] - min_accel[axis] > max_accel_span) return -4;
+        if (max_gyro[axis] - min_gyro[axis] > max_gyro_span) return -4;
+    }
+
+    int gravity_axis = 0;
+    int32_t mean_accel[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        mean_accel[axis] = icm_round_div(sum_accel[axis], n);
+        offsets->gyro[axis] = (int16_t)icm_round_div(sum_gyro[axis], n);
+        if (abs(mean_accel[axis]) > abs(mean_accel[gravity_axis])) gravity_axis = axis;
+    }
+    // Gravity is not an offset: remove 1 g from the axis it is on
+    mean_accel[gravity_axis] -= mean_accel[gravity_axis] >= 0 ? icm_scale.accel_lsb_per_g : -(int32_t)icm_scale.accel_lsb_per_g;
+    for (int axis = 0; axis < 3; ++axis) offsets->accel[axis] = (int16_t)mean_accel[axis];
+    offsets->temperature = (int8_t)icm_round_div(sum_temp, n);
+    offsets->scale = icm_scale;
+
+    // Gyroscope drift with the temperature, from two calibrations in the same range
+    for (int axis = 0; axis < 3; ++axis) offsets->gyro_tc_q8[axis] = 0;
+    if (previous && previous->scale.gyro_lsb_per_dps_x10 == icm_scale.gyro_lsb_per_dps_x10) {
+        int32_t delta = offsets->temperature - previous->temperature;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (abs(delta) < ICM42670_CALIB_TC_MIN_DELTA) {
+                offsets->gyro_tc_q8[axis] = previous->gyro_tc_q8[axis];
+                continue;
+            }
+            int32_t tc = (((int32_t)offsets->gyro[axis] - previous->gyro[axis]) * 256) / delta;
+            offsets->gyro_tc_q8[axis] = (int16_t)(tc > INT16_MAX ? INT16_MAX : (tc < INT16_MIN ? INT16_MIN : tc));
+        }
+    }
+    return 0;
+}
+
+void ICM42670_set_offsets(const icm42670_offsets_t *offsets) {
+    icm_offsets_valid = offsets != NULL && offsets->scale.accel_lsb_per_g != 0 &&
+                        offsets->scale.gyro_lsb_per_dps_x10 != 0;
+    if (icm_offsets_valid) icm_offsets = *offsets;
+    icm_apply_offsets();
+}
+
+bool ICM42670_get_offsets(icm42670_offsets_t *offsets) {
+    if (!icm_offsets_valid) return false;
+    *offsets = icm_offsets;
+    return true;
+}
+
+/* -------- Offsets in flash -------- */
+
+// Last sector of the flash, after the program
+#ifndef ICM42670_CALIB_FLASH_OFFSET
+#define ICM42670_CALIB_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#endif
+#define ICM42670_CALIB_MAGIC 0x434D4349u  // "ICMC"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;           // sizeof(icm42670_offsets_t), changes when the layout changes
+    icm42670_offsets_t offsets;
+    uint32_t checksum;       // FNV-1a of offsets
+} icm_offsets_record_t;
+
+static_assert(sizeof(icm_offsets_record_t) <= FLASH_PAGE_SIZE, "offsets record must fit one flash page");
+
+static uint32_t icm_checksum(const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Runs with the interrupts disabled and the other core parked, the flash is not readable meanwhile
+static void icm_flash_write(void *page) {
+    flash_range_erase(ICM42670_CALIB_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(ICM42670_CALIB_FLASH_OFFSET, page, FLASH_PAGE_SIZE);
+}
+
+int ICM42670_save_offsets(const icm42670_offsets_t *offsets) {
+    static uint8_t page[FLASH_PAGE_SIZE];
+    icm_offsets_record_t record;
+    // Zeroed first so the padding bytes checksummed and written are deterministic
+    memset(&record, 0, sizeof(record));
+    record.magic = ICM42670_CALIB_MAGIC;
+    record.size = sizeof(icm42670_offsets_t);
+    record.offsets = *offsets;
+    record.checksum = icm_checksum(&record.offsets, sizeof(record.offsets));
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &record, sizeof(record));
+    if (flash_safe_execute(icm_flash_write, page, 100) != PICO_OK) return -1;
+    return 0;
+}
+
+int ICM42670_load_offsets(icm42670_offsets_t *offsets) {
+    icm_offsets_record_t record;
+    memcpy(&record, (const void *)(XIP_BASE + ICM42670_CALIB_FLASH_OFFSET), sizeof(record));
+    if (record.magic != ICM42670_CALIB_MAGIC || record.size != sizeof(icm42670_offsets_t)) return -1;
+    if (record.checksum != icm_checksum(&record.offsets, sizeof(record.offsets))) return -2;
+    if (record.offsets.scale.accel_lsb_per_g == 0 || record.offsets.scale.gyro_lsb_per_dps_x10 == 0) return -2;
+    *offsets = record.offsets;
+    return 0;
+}
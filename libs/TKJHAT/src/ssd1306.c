@@ -39,23 +39,42 @@ inline static void swap(int32_t *a, int32_t *b) {
     *b=*t;
 }
 
-inline static void fancy_write(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, char *name) {
+inline static bool fancy_write(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, char *name) {
     switch(i2c_write_blocking(i2c, addr, src, len, false)) {
     case PICO_ERROR_GENERIC:
         printf("[%s] addr not acknowledged!\n", name);
-        break;
+        return false;
     case PICO_ERROR_TIMEOUT:
         printf("[%s] timeout!\n", name);
-        break;
+        return false;
     default:
         //printf("[%s] wrote successfully %lu bytes!\n", name, len);
-        break;
+        return true;
     }
 }
 
+// one transaction through the write of the caller if there is one, else straight to the i2c instance
+inline static bool ssd1306_send(ssd1306_t *p, const uint8_t *src, size_t len, char *name) {
+    if(p->write)
+        return p->write(p->address, src, len);
+    return fancy_write(p->i2c_i, p->address, src, len, name);
+}
+
 inline static void ssd1306_write(ssd1306_t *p, uint8_t val) {
     uint8_t d[2]= {0x00, val};
-    fancy_write(p->i2c_i, p->address, d, 2, "ssd1306_write");
+    ssd1306_send(p, d, 2, "ssd1306_write");
+}
+
+inline static void ssd1306_mark_clean(ssd1306_t *p) {
+    memset(p->dirty_x0, 0xff, sizeof(p->dirty_x0));
+    memset(p->dirty_x1, 0, sizeof(p->dirty_x1));
+}
+
+inline static void ssd1306_mark_dirty_columns(ssd1306_t *p, uint32_t page, uint32_t x0, uint32_t x1) {
+    if(x0<p->dirty_x0[page])
+        p->dirty_x0[page]=x0;
+    if(x1>p->dirty_x1[page])
+        p->dirty_x1[page]=x1;
 }
 
 bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address, i2c_inst_t *i2c_instance) {
@@ -68,13 +87,31 @@ bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address
 
 
     p->bufsize=(p->pages)*(p->width);
+    if(p->pages>SSD1306_MAX_PAGES || p->width>128)
+        return false;
     if((p->buffer=malloc(p->bufsize+1))==NULL) {
         p->bufsize=0;
         return false;
     }
+    p->shadow=malloc(p->bufsize);
+    // data, per page the address commands and a control byte, and the control bytes of the chunks
+    p->txbuf=malloc(p->bufsize+p->pages*(7+1)+p->bufsize/SSD1306_UPDATE_CHUNK);
+    if(p->shadow==NULL || p->txbuf==NULL) {
+        free(p->shadow);
+        free(p->txbuf);
+        free(p->buffer);
+        p->bufsize=0;
+        return false;
+    }
 
     ++(p->buffer);
 
+    p->txcount=0;
+
+    // the display ram is unknown until the first show
+    p->shadow_valid=false;
+    ssd1306_mark_clean(p);
+
     // from https://github.com/makerportal/rpi-pico-ssd1306
     uint8_t cmds[]= {
         SET_DISP,
@@ -117,6 +154,8 @@ bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address
 
 inline void ssd1306_deinit(ssd1306_t *p) {
     free(p->buffer-1);
+    free(p->shadow);
+    free(p->txbuf);
 }
 
 inline void ssd1306_poweroff(ssd1306_t *p) {
@@ -138,18 +177,30 @@ inline void ssd1306_invert(ssd1306_t *p, uint8_t inv) {
 
 inline void ssd1306_clear(ssd1306_t *p) {
     memset(p->buffer, 0, p->bufsize);
+    ssd1306_mark_dirty(p, 0, 0, p->width, p->height);
+}
+
+void ssd1306_mark_dirty(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    if(x>=p->width || y>=p->height || width==0 || height==0) return;
+
+    uint32_t x1=x+width-1<p->width?x+width-1:p->width-1;
+    uint32_t y1=y+height-1<p->height?y+height-1:p->height-1;
+    for(uint32_t page=y>>3; page<=(y1>>3); ++page)
+        ssd1306_mark_dirty_columns(p, page, x, x1);
 }
 
 void ssd1306_clear_pixel(ssd1306_t *p, uint32_t x, uint32_t y) {
     if(x>=p->width || y>=p->height) return;
 
     p->buffer[x+p->width*(y>>3)]&=~(0x1<<(y&0x07));
+    ssd1306_mark_dirty_columns(p, y>>3, x, x);
 }
 
 void ssd1306_draw_pixel(ssd1306_t *p, uint32_t x, uint32_t y) {
     if(x>=p->width || y>=p->height) return;
 
     p->buffer[x+p->width*(y>>3)]|=0x1<<(y&0x07); // y>>3==y/8 && y&0x7==y%8
+    ssd1306_mark_dirty_columns(p, y>>3, x, x);
 }
 
 void ssd1306_draw_line(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
@@ -193,10 +244,92 @@ void ssd1306_draw_empty_square(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t wi
     ssd1306_draw_line(p, x+width, y, x+width, y+height);
 }
 
+// glyphs of a font at one scale, in display format: per glyph column, the bytes of its pages
+typedef struct {
+    const uint8_t *font;
+    uint32_t scale;
+    uint8_t *data;
+} glyph_cache_t;
+
+static glyph_cache_t glyph_cache[SSD1306_GLYPH_CACHE_SLOTS];
+
+// stretch the 8 rows of a glyph column over scale page bytes
+static void ssd1306_glyph_column(uint8_t column, uint32_t scale, uint8_t *out) {
+    for(uint32_t k=0; k<scale; ++k) {
+        uint8_t byte=0;
+        for(uint32_t j=0; j<8; ++j)
+            if((column>>((k*8+j)/scale))&1)
+                byte|=1<<j;
+        out[k]=byte;
+    }
+}
+
+// the glyphs of font at scale, rendered on first use, NULL if they cannot be cached
+static const uint8_t *ssd1306_glyph_cache_get(const uint8_t *font, uint32_t scale) {
+    if(scale==0 || scale>SSD1306_GLYPH_CACHE_MAX_SCALE || font[0]>8)
+        return NULL;
+
+    glyph_cache_t *slot=NULL;
+    for(size_t i=0; i<SSD1306_GLYPH_CACHE_SLOTS; ++i) {
+        if(glyph_cache[i].data && glyph_cache[i].font==font && glyph_cache[i].scale==scale)
+            return glyph_cache[i].data;
+        if(!glyph_cache[i].data && !slot)
+            slot=&glyph_cache[i];
+    }
+    if(!slot)
+        return NULL;
+
+    uint32_t glyphs=font[4]-font[3]+1;
+    uint32_t columns=glyphs*font[1];
+    uint8_t *data=malloc(columns*scale*scale);
+    if(!data)
+        return NULL;
+    // every source column becomes scale columns of scale bytes
+    for(uint32_t i=0; i<columns; ++i) {
+        ssd1306_glyph_column(font[i+5], scale, data+i*scale*scale);
+        for(uint32_t r=1; r<scale; ++r)
+            memcpy(data+(i*scale+r)*scale, data+i*scale*scale, scale);
+    }
+
+    slot->font=font;
+    slot->scale=scale;
+    slot->data=data;
+    return data;
+}
+
+bool ssd1306_glyph_cache_init(const uint8_t *font, uint32_t scale) {
+    return ssd1306_glyph_cache_get(font, scale)!=NULL;
+}
+
+// or the bytes of a cached glyph into the buffer, shifted down when y is not on a page boundary
+static void ssd1306_blit_glyph(ssd1306_t *p, uint32_t x, uint32_t y, const uint8_t *glyph, uint32_t columns, uint32_t pages) {
+    if(x>=p->width || y>=p->height)
+        return;
+
+    uint32_t page=y>>3, shift=y&7;
+    uint32_t end=x+columns<p->width?x+columns:p->width;
+    for(uint32_t px=x; px<end; ++px, glyph+=pages) {
+        uint8_t *dst=p->buffer+page*p->width+px;
+        for(uint32_t k=0; k<pages && page+k<p->pages; ++k, dst+=p->width) {
+            dst[0]|=glyph[k]<<shift;
+            if(shift && page+k+1<p->pages)
+                dst[p->width]|=glyph[k]>>(8-shift);
+        }
+    }
+    ssd1306_mark_dirty(p, x, y, columns, pages*8);
+}
+
 void ssd1306_draw_char_with_font(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t scale, const uint8_t *font, char c) {
     if(c<font[3]||c>font[4])
         return;
 
+    const uint8_t *cache=ssd1306_glyph_cache_get(font, scale);
+    if(cache) {
+        uint32_t glyph_size=font[1]*scale*scale;
+        ssd1306_blit_glyph(p, x, y, cache+(c-font[3])*glyph_size, font[1]*scale, scale);
+        return;
+    }
+
     uint32_t parts_per_line=(font[0]>>3)+((font[0]&7)>0);
     for(uint8_t w=0; w<font[1]; ++w) { // width
         uint32_t pp=(c-font[3])*font[1]*parts_per_line+w*parts_per_line+5;
@@ -219,6 +352,43 @@ void ssd1306_draw_string_with_font(ssd1306_t *p, uint32_t x, uint32_t y, uint32_
     }
 }
 
+void ssd1306_draw_string_window_with_font(ssd1306_t *p, uint32_t page, uint32_t scale, const uint8_t *font, const char *s, int32_t offset) {
+    if(scale==0 || page+scale>p->pages || font[0]>8)
+        return;
+
+    // the text is a strip of columns, the display shows the columns offset..offset+width-1 of it
+    const uint8_t *cache=ssd1306_glyph_cache_get(font, scale);
+    uint32_t advance=(font[1]+font[2])*scale;
+    size_t len=strlen(s);
+    for(uint32_t x=0; x<p->width; ++x) {
+        int32_t strip_x=offset+(int32_t)x;
+        uint8_t bytes[SSD1306_MAX_PAGES]= {0};
+        const uint8_t *column=bytes;
+        if(strip_x>=0 && (uint32_t)strip_x/advance<len) {
+            char c=s[strip_x/advance];
+            uint32_t cx=strip_x%advance;
+            if(cx<font[1]*scale && c>=font[3] && c<=font[4]) {
+                if(cache)
+                    column=cache+((c-font[3])*font[1]*scale+cx)*scale;
+                else
+                    ssd1306_glyph_column(font[(c-font[3])*font[1]+cx/scale+5], scale, bytes);
+            }
+        }
+
+        for(uint32_t k=0; k<scale; ++k)
+            p->buffer[(page+k)*p->width+x]=column[k];
+    }
+    ssd1306_mark_dirty(p, 0, page*8, p->width, scale*8);
+}
+
+void ssd1306_draw_string_window(ssd1306_t *p, uint32_t page, uint32_t scale, const char *s, int32_t offset) {
+    ssd1306_draw_string_window_with_font(p, page, scale, font_8x5, s, offset);
+}
+
+uint32_t ssd1306_string_width(uint32_t scale, const char *s) {
+    return strlen(s)*(font_8x5[1]+font_8x5[2])*scale;
+}
+
 void ssd1306_draw_char(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t scale, char c) {
     ssd1306_draw_char_with_font(p, x, y, scale, font_8x5, c);
 }
@@ -290,17 +460,121 @@ inline void ssd1306_bmp_show_image(ssd1306_t *p, const uint8_t *data, const long
     ssd1306_bmp_show_image_with_offset(p, data, size, 0, 0);
 }
 
-void ssd1306_show(ssd1306_t *p) {
-    uint8_t payload[]= {SET_COL_ADDR, 0, p->width-1, SET_PAGE_ADDR, 0, p->pages-1};
-    if(p->width==64) {
-        payload[1]+=32;
-        payload[2]+=32;
+// narrow the dirty columns of a page to the ones that differ from the display ram, false if none does
+static bool ssd1306_trim_page(ssd1306_t *p, uint32_t page) {
+    uint32_t x0=p->dirty_x0[page], x1=p->dirty_x1[page];
+    if(x0>x1)
+        return false;
+    if(!p->shadow_valid)
+        return true;
+
+    const uint8_t *buf=p->buffer+page*p->width;
+    const uint8_t *shadow=p->shadow+page*p->width;
+    while(x0<=x1 && buf[x0]==shadow[x0])
+        ++x0;
+    if(x0>x1)
+        return false;
+    while(buf[x1]==shadow[x1])
+        --x1;
+
+    p->dirty_x0[page]=x0;
+    p->dirty_x1[page]=x1;
+    return true;
+}
+
+// add one i2c transaction of len bytes to the update, returns where its bytes go
+static uint8_t *ssd1306_add_transaction(ssd1306_t *p, size_t len) {
+    uint16_t offset=p->txcount?p->tx[p->txcount-1].offset+p->tx[p->txcount-1].len:0;
+    p->tx[p->txcount].offset=offset;
+    p->tx[p->txcount].len=len;
+    ++(p->txcount);
+    return p->txbuf+offset;
+}
+
+// add the columns x0..x1 of the pages p0..p1 to the update: the address commands in one transaction, then the data
+// in chunks, each a transaction of its own with its control byte
+static void ssd1306_add_area(ssd1306_t *p, uint32_t p0, uint32_t p1, uint32_t x0, uint32_t x1) {
+    uint32_t offset=p->width==64?32:0;
+    uint8_t cmds[]= {0x00, SET_COL_ADDR, x0+offset, x1+offset, SET_PAGE_ADDR, p0, p1};
+    memcpy(ssd1306_add_transaction(p, sizeof(cmds)), cmds, sizeof(cmds));
+
+    uint32_t columns=x1-x0+1;
+    uint32_t left=columns*(p1-p0+1);
+    uint32_t page=p0, x=x0;
+    while(left>0) {
+        uint32_t len=left<SSD1306_UPDATE_CHUNK?left:SSD1306_UPDATE_CHUNK;
+        uint8_t *data=ssd1306_add_transaction(p, len+1);
+        *(data++)=0x40;
+        for(uint32_t i=0; i<len; ++i) {
+            *(data++)=p->buffer[page*p->width+x];
+            if(++x>x1) {
+                x=x0;
+                ++page;
+            }
+        }
+        left-=len;
+    }
+
+    for(page=p0; page<=p1; ++page) {
+        size_t start=page*p->width+x0;
+        memcpy(p->shadow+start, p->buffer+start, columns);
+    }
+}
+
+bool ssd1306_prepare_update(ssd1306_t *p) {
+    if(!p->shadow_valid)
+        ssd1306_mark_dirty(p, 0, 0, p->width, p->height);
+
+    // area being collected: pages p0..p1, columns x0..x1, of which changed bytes are worth sending
+    uint32_t p0=0, p1=0, x0=0, x1=0, changed=0;
+    bool open=false;
+    p->txcount=0;
+    for(uint32_t page=0; page<p->pages; ++page) {
+        if(!ssd1306_trim_page(p, page))
+            continue;
+
+        uint32_t px0=p->dirty_x0[page], px1=p->dirty_x1[page];
+        if(open && page==p1+1) {
+            // grow the area over this page if the unchanged bytes it adds cost less than one more update
+            uint32_t ux0=px0<x0?px0:x0;
+            uint32_t ux1=px1>x1?px1:x1;
+            if((ux1-ux0+1)*(page-p0+1)<=changed+(px1-px0+1)+SSD1306_UPDATE_OVERHEAD) {
+                p1=page;
+                x0=ux0;
+                x1=ux1;
+                changed+=px1-px0+1;
+                continue;
+            }
+        }
+        if(open)
+            ssd1306_add_area(p, p0, p1, x0, x1);
+        p0=p1=page;
+        x0=px0;
+        x1=px1;
+        changed=px1-px0+1;
+        open=true;
     }
+    if(open)
+        ssd1306_add_area(p, p0, p1, x0, x1);
 
-    for(size_t i=0; i<sizeof(payload); ++i)
-        ssd1306_write(p, payload[i]);
+    // the shadow holds the update now: a sender that fails calls ssd1306_invalidate()
+    p->shadow_valid=true;
+    ssd1306_mark_clean(p);
+    return p->txcount>0;
+}
 
-    *(p->buffer-1)=0x40;
+inline void ssd1306_invalidate(ssd1306_t *p) {
+    p->shadow_valid=false;
+}
 
-    fancy_write(p->i2c_i, p->address, p->buffer-1, p->bufsize+1, "ssd1306_show");
-}
\ No newline at end of file
+void ssd1306_show(ssd1306_t *p) {
+    if(!ssd1306_prepare_update(p))
+        return;
+    for(uint8_t i=0; i<p->txcount; ++i) {
+        if(!ssd1306_send(p, p->txbuf+p->tx[i].offset, p->tx[i].len, "ssd1306_show")) {
+            // after a failed write the display ram is unknown again: the next show sends everything
+            ssd1306_invalidate(p);
+            return;
+        }
+    }
+}
@@ -0,0 +1,237 @@
+#include "gesture.h"
+
+// Table units (mg, dps, °C) to raw counts
+static int32_t gesture_to_raw(uint8_t channel, int32_t value, const struct GestureScale *scale)
+{
+    if (channel == GESTURE_TEMP_RISE)
+        return value * scale->tempLsbPerC;
+    // The orientation is given in 0.01°
+    if (channel == GESTURE_ROLL || channel == GESTURE_PITCH)
+        return value * 100;
+    uint8_t axis = channel >= GESTURE_AX_ABS ? channel - GESTURE_AX_ABS : channel;
+    if (axis <= GESTURE_AZ)
+        return value * (int32_t)scale->accelLsbPerG / 1000;
+    return value * (int32_t)scale->gyroLsbPerDpsX10 / 10;
+}
+
+// min < value < max as the half-open raw range [lo, hi)
+static void gesture_window_range(const struct GestureWindow *window, const struct GestureScale *scale, int32_t *lo, int32_t *hi)
+{
+    *lo = window->min == GESTURE_OPEN_MIN ? INT32_MIN : gesture_to_raw(window->channel, window->min, scale) + 1;
+    *hi = window->max == GESTURE_OPEN_MAX ? INT32_MAX : gesture_to_raw(window->channel, window->max, scale);
+}
+
+// Returns false if the table is full
+static bool gesture_add_breakpoint(struct GestureChannelTable *table, int32_t value)
+{
+    // Open bounds do not split the channel
+    if (value == INT32_MIN || value == INT32_MAX)
+        return true;
+    // Duplicates are kept once, a new value needs a free slot
+    for (uint8_t k = 0; k < table->breakpointCount; k++)
+    {
+        if (table->breakpoints[k] == value)
+            return true;
+    }
+    if (table->breakpointCount >= GESTURE_MAX_BREAKPOINTS)
+        return false;
+    // Insertion sort
+    uint8_t i = table->breakpointCount;
+    while (i > 0 && table->breakpoints[i - 1] > value)
+    {
+        table->breakpoints[i] = table->breakpoints[i - 1];
+        i--;
+    }
+    table->breakpoints[i] = value;
+    table->breakpointCount++;
+    return true;
+}
+
+bool gesture_compile(struct GestureEngine *engine, const struct GestureRule *rules, size_t ruleCount,
+                     const struct GestureScale *scale, const struct GestureTiming *timing)
+{
+    if (ruleCount > GESTURE_MAX_RULES)
+        return false;
+    if (timing->window == 0 || timing->window > GESTURE_MAX_HISTORY || timing->enter > timing->window ||
+        timing->enter == 0 || timing->exit >= timing->enter)
+        return false;
+    engine->timing = *timing;
+    engine->rules = rules;
+    engine->ruleCount = (uint8_t)ruleCount;
+    engine->tableCount = 0;
+    gesture_reset(engine);
+
+    // Map each used channel to its table
+    int8_t tableOf[GESTURE_CHANNEL_COUNT];
+    for (uint8_t c = 0; c < GESTURE_CHANNEL_COUNT; c++)
+        tableOf[c] = -1;
+    for (size_t r = 0; r < ruleCount; r++)
+    {
+        if (rules[r].windowCount > GESTURE_MAX_WINDOWS || rules[r].event == GESTURE_NO_EVENT)
+            return false;
+        for (uint8_t w = 0; w < rules[r].windowCount; w++)
+        {
+            uint8_t channel = rules[r].windows[w].channel;
+            if (channel >= GESTURE_CHANNEL_COUNT)
+                return false;
+            if (tableOf[channel] < 0)
+            {
+                struct GestureChannelTable *table = &engine->tables[engine->tableCount];
+                table->channel = channel;
+                table->breakpointCount = 0;
+                tableOf[channel] = (int8_t)engine->tableCount++;
+            }
+            int32_t lo, hi;
+            gesture_window_range(&rules[r].windows[w], scale, &lo, &hi);
+            if (!gesture_add_breakpoint(&engine->tables[tableOf[channel]], lo) ||
+                !gesture_add_breakpoint(&engine->tables[tableOf[channel]], hi))
+                return false;
+        }
+    }
+
+    // Mask of every range: a rule is set if it has no window on the channel, or its window holds the range
+    for (uint8_t t = 0; t < engine->tableCount; t++)
+    {
+        struct GestureChannelTable *table = &engine->tables[t];
+        for (uint8_t range = 0; range <= table->breakpointCount; range++)
+        {
+            // Lowest value of the range, every value of a range has the same answer
+            int32_t value = range == 0 ? INT32_MIN : table->breakpoints[range - 1];
+            uint16_t mask = 0;
+            for (size_t r = 0; r < ruleCount; r++)
+            {
+                bool inside = true;
+                for (uint8_t w = 0; w < rules[r].windowCount; w++)
+                {
+                    if (rules[r].windows[w].channel != table->channel)
+                        continue;
+                    int32_t lo, hi;
+                    gesture_window_range(&rules[r].windows[w], scale, &lo, &hi);
+                    if (value < lo || value >= hi)
+                        inside = false;
+                }
+                if (inside)
+                    mask |= (uint16_t)(1u << r);
+            }
+            table->masks[range] = mask;
+        }
+    }
+    return true;
+}
+
+void gesture_reset(struct GestureEngine *engine)
+{
+    for (uint8_t i = 0; i < GESTURE_MAX_HISTORY; i++)
+        engine->history[i] = 0;
+    for (uint8_t r = 0; r < GESTURE_MAX_RULES; r++)
+        engine->matchCount[r] = 0;
+    engine->historyHead = 0;
+    engine->active = 0;
+    engine->fired = 0;
+    engine->sampleIndex = 0;
+    engine->refractoryEnd = 0;
+}
+
+static int32_t gesture_channel_value(uint8_t channel, const struct GestureInput *input)
+{
+    switch (channel)
+    {
+    case GESTURE_AX:
+    case GESTURE_AY:
+    case GESTURE_AZ:
+        return input->accel[channel - GESTURE_AX];
+    case GESTURE_GX:
+    case GESTURE_GY:
+    case GESTURE_GZ:
+        return input->gyro[channel - GESTURE_GX];
+    case GESTURE_AX_ABS:
+    case GESTURE_AY_ABS:
+    case GESTURE_AZ_ABS:
+    {
+        int32_t v = input->accel[channel - GESTURE_AX_ABS];
+        return v < 0 ? -v : v;
+    }
+    case GESTURE_GX_ABS:
+    case GESTURE_GY_ABS:
+    case GESTURE_GZ_ABS:
+    {
+        int32_t v = input->gyro[channel - GESTURE_GX_ABS];
+        return v < 0 ? -v : v;
+    }
+    case GESTURE_ROLL:
+        return input->roll;
+    case GESTURE_PITCH:
+        return input->pitch;
+    default:
+        return input->tempRise;
+    }
+}
+
+const struct GestureRule *gesture_evaluate(struct GestureEngine *engine, const struct GestureInput *input)
+{
+    // Every rule starts as a match, each used channel clears the rules it rejects
+    uint16_t matches = (uint16_t)((1u << engine->ruleCount) - 1);
+    for (uint8_t t = 0; t < engine->tableCount && matches; t++)
+    {
+        const struct GestureChannelTable *table = &engine->tables[t];
+        int32_t value = gesture_channel_value(table->channel, input);
+        // Binary search: number of breakpoints <= value is the range of the value
+        uint8_t lo = 0, hi = table->breakpointCount;
+        while (lo < hi)
+        {
+            uint8_t mid = (uint8_t)((lo + hi) >> 1);
+            if (table->breakpoints[mid] <= value)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        matches &= table->masks[lo];
+    }
+
+    // Slide the window: only the rules whose bit differs between the new and the dropped sample change count
+    uint32_t now = engine->sampleIndex++;
+    uint16_t dropped = engine->history[engine->historyHead];
+    engine->history[engine->historyHead] = matches;
+    engine->historyHead = (uint8_t)((engine->historyHead + 1) % engine->timing.window);
+    uint16_t changed = matches ^ dropped;
+    while (changed)
+    {
+        uint8_t r = (uint8_t)__builtin_ctz(changed);
+        uint16_t bit = (uint16_t)(1u << r);
+        changed &= (uint16_t)~bit;
+        if (matches & bit)
+            engine->matchCount[r]++;
+        else
+            engine->matchCount[r]--;
+
+        // Hysteresis: enter high, exit low, so a noisy sample near the edge does not toggle the rule
+        if (!(engine->active & bit) && engine->matchCount[r] >= engine->timing.enter)
+        {
+            engine->active |= bit;
+            engine->activeSince[r] = now;
+        }
+        else if ((engine->active & bit) && engine->matchCount[r] <= engine->timing.exit)
+        {
+            // Holding a gesture fires it once, it fires again only after it was left
+            engine->active &= (uint16_t)~bit;
+            engine->fired &= (uint16_t)~bit;
+        }
+    }
+
+    if (now < engine->refractoryEnd)
+        return NULL;
+    // First active rule of the table that was held long enough and did not fire yet
+    uint16_t ready = engine->active & (uint16_t)~engine->fired;
+    while (ready)
+    {
+        uint8_t r = (uint8_t)__builtin_ctz(ready);
+        uint16_t bit = (uint16_t)(1u << r);
+        ready &= (uint16_t)~bit;
+        if (now - engine->activeSince[r] < engine->rules[r].hold)
+            continue;
+        engine->fired |= bit;
+        engine->refractoryEnd = now + 1 + engine->timing.refractory;
+        return &engine->rules[r];
+    }
+    return NULL;
+}
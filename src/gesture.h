@@ -0,0 +1,132 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Rules one engine can hold (one bit each in the match masks)
+#define GESTURE_MAX_RULES 16
+// Axis windows one rule can check
+#define GESTURE_MAX_WINDOWS 4
+// Distinct window bounds one channel can split on: two per rule. Several windows of a rule on the same channel
+// share this room, gesture_compile() refuses a channel with more bounds.
+#define GESTURE_MAX_BREAKPOINTS (2 * GESTURE_MAX_RULES)
+// Longest sliding window of samples the detector can keep
+#define GESTURE_MAX_HISTORY 32
+// Bound of a window that has no limit on that side
+#define GESTURE_OPEN_MIN INT16_MIN
+#define GESTURE_OPEN_MAX INT16_MAX
+// Value returned when no rule fires on a sample
+#define GESTURE_NO_EVENT 0
+
+// Values of a sample a window can check. The _ABS channels compare the magnitude of the axis.
+enum GestureChannel
+{
+    GESTURE_AX,
+    GESTURE_AY,
+    GESTURE_AZ,
+    GESTURE_GX,
+    GESTURE_GY,
+    GESTURE_GZ,
+    GESTURE_AX_ABS,
+    GESTURE_AY_ABS,
+    GESTURE_AZ_ABS,
+    GESTURE_GX_ABS,
+    GESTURE_GY_ABS,
+    GESTURE_GZ_ABS,
+    GESTURE_TEMP_RISE, // Temperature above the baseline
+    GESTURE_ROLL,      // Filtered orientation of the board
+    GESTURE_PITCH,
+    GESTURE_CHANNEL_COUNT
+};
+
+// One axis condition: min < value < max, in mg (accel), dps (gyro), °C (temperature) or degrees (roll, pitch)
+struct GestureWindow
+{
+    uint8_t channel;
+    int16_t min;
+    int16_t max;
+};
+
+// One gesture of the configuration table. When several gestures are ready on the same sample the first one of
+// the table wins, so a sample emits at most one event.
+struct GestureRule
+{
+    const char *name;
+    uint8_t event;       // Returned when the rule fires, must not be GESTURE_NO_EVENT
+    uint8_t hold;        // Samples the gesture must stay active before it fires
+    uint8_t windowCount; // Used entries of windows, every window must match
+    struct GestureWindow windows[GESTURE_MAX_WINDOWS];
+};
+
+// Sliding window detector shared by all the rules, counted in samples
+struct GestureTiming
+{
+    uint8_t window;     // Recent samples looked at (at most GESTURE_MAX_HISTORY)
+    uint8_t enter;      // A rule becomes active when at least this many samples of the window match it
+    uint8_t exit;       // and inactive again when at most this many match (hysteresis: exit < enter)
+    uint16_t refractory; // No gesture fires during this many samples after one fired
+};
+
+// Sensitivity used to turn the table units into raw sensor counts
+struct GestureScale
+{
+    uint16_t accelLsbPerG;
+    uint16_t gyroLsbPerDpsX10;
+    uint16_t tempLsbPerC;
+};
+
+// One sample in raw sensor counts
+struct GestureInput
+{
+    int16_t accel[3];
+    int16_t gyro[3];
+    int16_t tempRise; // Temperature minus the baseline
+    int16_t roll;     // Orientation in 0.01°, see orientation.h
+    int16_t pitch;
+};
+
+// Decision table of one used channel. The sorted breakpoints split the channel into ranges, and every range
+// has the mask of the rules whose window on this channel holds the whole range.
+struct GestureChannelTable
+{
+    uint8_t channel;
+    uint8_t breakpointCount;
+    int32_t breakpoints[GESTURE_MAX_BREAKPOINTS];
+    uint16_t masks[GESTURE_MAX_BREAKPOINTS + 1];
+};
+
+// Compiled rule table and the sliding window state
+struct GestureEngine
+{
+    const struct GestureRule *rules;
+    uint8_t ruleCount;
+    uint8_t tableCount; // Channels used by at least one rule
+    struct GestureChannelTable tables[GESTURE_CHANNEL_COUNT];
+    struct GestureTiming timing;
+    uint16_t history[GESTURE_MAX_HISTORY]; // Ring of the rules each recent sample matched
+    uint8_t historyHead;                   // Next entry of the ring to write
+    uint8_t matchCount[GESTURE_MAX_RULES]; // Samples of the window that match each rule
+    uint16_t active;                       // Rules inside their hysteresis band
+    uint16_t fired;                        // Active rules that already fired, they must exit before firing again
+    uint32_t activeSince[GESTURE_MAX_RULES];
+    uint32_t sampleIndex;                  // Samples seen since the last reset
+    uint32_t refractoryEnd;                // First sample allowed to fire again
+};
+
+// Compile the rules for the given sensitivity. The rules are not copied and must stay valid.
+// Returns false if there are too many rules or windows, a window uses an unknown channel, a channel has more than
+// GESTURE_MAX_BREAKPOINTS distinct bounds, or the timing is invalid.
+bool gesture_compile(struct GestureEngine *engine, const struct GestureRule *rules, size_t ruleCount,
+                     const struct GestureScale *scale, const struct GestureTiming *timing);
+
+// Forget the recent samples, e.g. when the samples stop for a while.
+void gesture_reset(struct GestureEngine *engine);
+
+// Check one sample in one pass: one binary search per used channel, the rules are checked in parallel as bits.
+// The sample then enters the sliding window. Returns the rule that fires on this sample: active for its hold
+// time, not fired since it became active, and out of the refractory period. Otherwise NULL.
+const struct GestureRule *gesture_evaluate(struct GestureEngine *engine, const struct GestureInput *input);
+
+#endif
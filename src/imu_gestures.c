@@ -0,0 +1,100 @@
+#include "imu_gestures.h"
+
+// Gesture times given in ms, as a number of samples
+#define GESTURE_SAMPLES(ms) ((ms) * IMU_GESTURES_ODR_HZ / 1000)
+// Sliding window of the gesture detector: a gesture is active when 7 of the last 10 samples (50 ms) match it,
+// and ends when only 2 still match. After a symbol no gesture fires for 300 ms.
+#define GESTURE_WINDOW GESTURE_SAMPLES(50)
+#define GESTURE_ENTER 7
+#define GESTURE_EXIT 2
+#define GESTURE_REFRACTORY_MS 300
+// Fast moves fire as soon as they are active, the positions must be held to not fire while passing through them.
+// The positions are checked on the filtered orientation, which does not jitter, so a short hold is enough.
+#define GESTURE_MOVE_HOLD_MS 0
+#define GESTURE_POSITION_HOLD_MS 150
+// Orientation filter time constant: 2^5 samples (160 ms at 200 Hz)
+#define ORIENTATION_ACCEL_SHIFT 5
+
+// Gestures read from the IMU, checked in this order. A new gesture is one more line here.
+// Units: mg for the accelerometer, dps for the gyroscope, °C above the first temperature, degrees for the
+// orientation (flat and face up is roll 0, pitch 0).
+static const struct GestureRule gestureRules[] = {
+    // Shake the device: music, and back to IDLE
+    {"shake", IMU_GESTURE_SHAKE, GESTURE_SAMPLES(GESTURE_MOVE_HOLD_MS), 3,
+     {{GESTURE_GX_ABS, 200, GESTURE_OPEN_MAX}, {GESTURE_GY_ABS, 200, GESTURE_OPEN_MAX}, {GESTURE_GZ_ABS, 200, GESTURE_OPEN_MAX}}},
+    // Move the head fast from down to up
+    {"head down to up", IMU_GESTURE_DOT, GESTURE_SAMPLES(GESTURE_MOVE_HOLD_MS), 3,
+     {{GESTURE_GX, GESTURE_OPEN_MIN, -200}, {GESTURE_GY_ABS, GESTURE_OPEN_MIN, 110}, {GESTURE_GZ_ABS, GESTURE_OPEN_MIN, 110}}},
+    // Tilt left fast
+    {"tilt left fast", IMU_GESTURE_DASH, GESTURE_SAMPLES(GESTURE_MOVE_HOLD_MS), 3,
+     {{GESTURE_GX_ABS, GESTURE_OPEN_MIN, 70}, {GESTURE_GY, 200, GESTURE_OPEN_MAX}, {GESTURE_GZ_ABS, GESTURE_OPEN_MIN, 70}}},
+    // Lying on the left side and warmed up by the hand
+    {"tilt left and warm", IMU_GESTURE_DOT, GESTURE_SAMPLES(GESTURE_POSITION_HOLD_MS), 2,
+     {{GESTURE_PITCH, 80, GESTURE_OPEN_MAX}, {GESTURE_TEMP_RISE, 1, GESTURE_OPEN_MAX}}},
+    // Lying on the right side and warmed up by the hand
+    {"tilt right and warm", IMU_GESTURE_DASH, GESTURE_SAMPLES(GESTURE_POSITION_HOLD_MS), 2,
+     {{GESTURE_PITCH, GESTURE_OPEN_MIN, -80}, {GESTURE_TEMP_RISE, 1, GESTURE_OPEN_MAX}}},
+    // Lying flat
+    {"flat", IMU_GESTURE_DOT, GESTURE_SAMPLES(GESTURE_POSITION_HOLD_MS), 2,
+     {{GESTURE_ROLL, -10, 10}, {GESTURE_PITCH, -10, 10}}},
+    // Standing on its edge
+    {"on the edge", IMU_GESTURE_DASH, GESTURE_SAMPLES(GESTURE_POSITION_HOLD_MS), 2,
+     {{GESTURE_ROLL, -100, -80}, {GESTURE_PITCH, -10, 10}}},
+};
+
+bool imu_gestures_init(struct ImuGestures *gestures, const icm42670_scale_t *scale)
+{
+    struct GestureScale gestureScale = {scale->accel_lsb_per_g, scale->gyro_lsb_per_dps_x10, ICM42670_FIFO_TEMP_LSB_PER_C};
+    struct GestureTiming gestureTiming = {GESTURE_WINDOW, GESTURE_ENTER, GESTURE_EXIT, GESTURE_SAMPLES(GESTURE_REFRACTORY_MS)};
+    gestures->hasTempBaseline = false;
+    orientation_init(&gestures->orientation, scale->accel_lsb_per_g, scale->gyro_lsb_per_dps_x10, IMU_GESTURES_ODR_HZ,
+                     ORIENTATION_ACCEL_SHIFT);
+    // Turn the rule table into raw count decision tables once
+    return gesture_compile(&gestures->engine, gestureRules, sizeof(gestureRules) / sizeof(gestureRules[0]), &gestureScale,
+                           &gestureTiming);
+}
+
+void imu_gestures_reset(struct ImuGestures *gestures)
+{
+    gesture_reset(&gestures->engine);
+    orientation_reset(&gestures->orientation);
+}
+
+void imu_gestures_set_temperature_baseline(struct ImuGestures *gestures, int8_t temperature)
+{
+    gestures->tempBaseline = temperature;
+    gestures->hasTempBaseline = true;
+}
+
+const struct GestureRule *imu_gestures_process(struct ImuGestures *gestures, const icm42670_fifo_packet_t *packet,
+                                               struct OrientationAngles *orientation)
+{
+    // Without a calibration the first sample is the baseline
+    if (!gestures->hasTempBaseline)
+        imu_gestures_set_temperature_baseline(gestures, packet->temperature);
+    // The filter runs at the sensor rate, the gestures are checked on its angles
+    struct OrientationAngles angles = orientation_update(&gestures->orientation, packet->accel, packet->gyro);
+    if (orientation)
+        *orientation = angles;
+    struct GestureInput input = {
+        {packet->accel[0], packet->accel[1], packet->accel[2]},
+        {packet->gyro[0], packet->gyro[1], packet->gyro[2]},
+        (int16_t)(packet->temperature - gestures->tempBaseline),
+        angles.roll,
+        angles.pitch};
+    // One pass over the rule table, at most one gesture per sample
+    return gesture_evaluate(&gestures->engine, &input);
+}
+
+char imu_gestures_symbol(const struct GestureRule *gesture)
+{
+    switch (gesture->event)
+    {
+    case IMU_GESTURE_DOT:
+        return '.';
+    case IMU_GESTURE_DASH:
+        return '-';
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef IMU_GESTURES_H
+#define IMU_GESTURES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tkjhat/sdk.h"
+#include "gesture.h"
+#include "orientation.h"
+
+// Output data rate the gesture table is written for
+#define IMU_GESTURES_ODR_HZ 200
+
+// What a fired gesture means (GestureRule.event)
+enum ImuGesture
+{
+    IMU_GESTURE_DOT = 1,
+    IMU_GESTURE_DASH,
+    IMU_GESTURE_SHAKE
+};
+
+// Everything between a raw FIFO packet and a gesture: the orientation filter, the temperature baseline and the
+// compiled rule table. It has no sensor or RTOS calls, so the same code runs on the board and in the host replay.
+struct ImuGestures
+{
+    struct GestureEngine engine;
+    struct OrientationFilter orientation;
+    int8_t tempBaseline;    // FIFO temperature the warm gestures compare with
+    bool hasTempBaseline;   // false: the next sample sets the baseline
+};
+
+// Compile the gesture table for the sensitivity of the sensor ranges. Returns false if the table is invalid.
+bool imu_gestures_init(struct ImuGestures *gestures, const icm42670_scale_t *scale);
+
+// Forget the recent samples and the orientation, e.g. when a new reading starts. The temperature baseline is kept.
+void imu_gestures_reset(struct ImuGestures *gestures);
+
+// Use this FIFO temperature as the baseline instead of the first sample, e.g. the one measured at calibration.
+void imu_gestures_set_temperature_baseline(struct ImuGestures *gestures, int8_t temperature);
+
+// Run one packet through the pipeline. Returns the gesture that fires on it or NULL. orientation (may be NULL)
+// gets the filtered angles of the packet.
+const struct GestureRule *imu_gestures_process(struct ImuGestures *gestures, const icm42670_fifo_packet_t *packet,
+                                               struct OrientationAngles *orientation);
+
+// The morse symbol of a gesture: '.', '-', or 0 for a gesture that is not a symbol (shake).
+char imu_gestures_symbol(const struct GestureRule *gesture);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <hardware/gpio.h>
+#include <FreeRTOS.h>
+#include <stream_buffer.h>
+
+#include "imu_stream.h"
+
+static StreamBufferHandle_t imuStreamBuffer = NULL;
+static TaskHandle_t imuAcquisitionTask = NULL;
+static uint16_t imuWatermark = 1;
+// Packets of the last burst, and the same packets with their time (static: too big for the task stack)
+static icm42670_fifo_packet_t imuBurst[ICM42670_FIFO_MAX_BURST];
+static struct ImuSample imuSamples[ICM42670_FIFO_MAX_BURST];
+// Sensor time of the last sample: 16 bit sensor timestamp extended with the elapsed microseconds
+static uint32_t imuTimeUs = 0;
+static uint16_t imuLastTimestamp = 0;
+static bool imuTimeStarted = false;
+// Wake-on-motion: threshold (0 = off), the same in counts, and the time without motion before sleeping
+static uint16_t imuWomThresholdMg = 0;
+static int32_t imuMotionAccel = 0;
+static int32_t imuMotionGyro = 0;
+static uint32_t imuIdleUs = 0;
+static bool imuAsleep = false;
+// Sample the motion is measured from, and the sample time it was taken
+static int16_t imuMotionReference[3];
+static uint32_t imuLastMotionUs = 0;
+
+// INT1 pulses low when the FIFO watermark is reached
+static void imu_stream_irq(void)
+{
+    if ((gpio_get_irq_event_mask(ICM42670_INT) & GPIO_IRQ_EDGE_FALL) == 0)
+        return;
+    gpio_acknowledge_irq(ICM42670_INT, GPIO_IRQ_EDGE_FALL);
+    if (imuAcquisitionTask == NULL)
+        return;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(imuAcquisitionTask, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+bool imu_stream_init(uint16_t watermark)
+{
+    if (watermark == 0 || watermark > ICM42670_FIFO_MAX_BURST)
+        return false;
+    imuWatermark = watermark;
+    imuStreamBuffer = xStreamBufferCreate(IMU_STREAM_CAPACITY * sizeof(struct ImuSample), sizeof(struct ImuSample));
+    return imuStreamBuffer != NULL;
+}
+
+void imu_stream_start(TaskHandle_t acquisitionTask)
+{
+    imuAcquisitionTask = acquisitionTask;
+    if (ICM42670_enable_int1(ICM42670_FIFO_THS_INT1_EN) != 0)
+    {
+        printf("__ICM42670 INT1 could not be configured__\n");
+    }
+    // Own handler for the IMU pin, the buttons keep the default gpio callback
+    gpio_add_raw_irq_handler(ICM42670_INT, imu_stream_irq);
+    gpio_set_irq_enabled(ICM42670_INT, GPIO_IRQ_EDGE_FALL, true);
+}
+
+void imu_stream_reset(void)
+{
+    ICM42670_fifo_flush();
+    imuTimeStarted = false;
+    imuTimeUs = 0;
+    imuLastMotionUs = 0;
+    // Forget a notification given for the samples just dropped
+    ulTaskNotifyTake(pdTRUE, 0);
+}
+
+void imu_stream_set_wake_on_motion(uint16_t thresholdMg, uint32_t idleMs)
+{
+    icm42670_scale_t scale;
+    ICM42670_get_scale(&scale);
+    imuWomThresholdMg = thresholdMg;
+    imuMotionAccel = ICM42670_accel_mg_to_raw(&scale, thresholdMg);
+    imuMotionGyro = ICM42670_gyro_dps_to_raw(&scale, IMU_STREAM_MOTION_DPS);
+    imuIdleUs = idleMs * 1000;
+}
+
+void imu_stream_sleep(void)
+{
+    if (imuWomThresholdMg == 0 || imuAsleep)
+        return;
+    if (ICM42670_enable_wom(imuWomThresholdMg, IMU_STREAM_WOM_ODR_HZ) != 0)
+    {
+        printf("__ICM42670 wake-on-motion could not be enabled__\n");
+        return;
+    }
+    imuAsleep = true;
+    // The last watermark pulse may have come while switching
+    ulTaskNotifyTake(pdTRUE, 0);
+}
+
+// Motion interrupt: back to full rate streaming, the samples restart from time 0
+static int imu_stream_wake(void)
+{
+    uint8_t status = 0;
+    if (ICM42670_wom_status(&status) != 0)
+        return -1;
+    if ((status & ICM42670_WOM_XYZ_INT) == 0)
+        return 0;
+    imuAsleep = false;
+    if (ICM42670_disable_wom() != 0 || ICM42670_fifo_enable(imuWatermark) != 0)
+        return -2;
+    imu_stream_reset();
+    return 0;
+}
+
+// True if the sample moved away from the reference sample or rotates
+static bool imu_stream_moving(const icm42670_fifo_packet_t *packet)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (abs(packet->accel[axis] - imuMotionReference[axis]) > imuMotionAccel || abs(packet->gyro[axis]) > imuMotionGyro)
+            return true;
+    }
+    return false;
+}
+
+int imu_stream_acquire(TickType_t timeout)
+{
+    // Sleep between the bursts, the sensor clock decides when the next one is ready. While waiting for motion
+    // nothing is read until the motion interrupt comes, another one comes with the next move if one is missed.
+    ulTaskNotifyTake(pdTRUE, imuAsleep ? portMAX_DELAY : timeout);
+    if (imuAsleep)
+        return imu_stream_wake();
+
+    int pushed = 0;
+    uint16_t remaining = 0;
+    do
+    {
+        int count = ICM42670_fifo_read(imuBurst, imuWatermark, &remaining);
+        if (count < 0)
+            return count;
+
+        for (int i = 0; i < count; i++)
+        {
+            // The 16 bit timestamp wraps every 65 ms, far longer than the time between 2 samples
+            if (imuTimeStarted)
+                imuTimeUs += (uint16_t)(imuBurst[i].timestamp - imuLastTimestamp);
+            imuTimeStarted = true;
+            imuLastTimestamp = imuBurst[i].timestamp;
+            imuSamples[i].timeUs = imuTimeUs;
+            imuSamples[i].packet = imuBurst[i];
+            // The first sample after a reset is the first motion reference
+            if (imuTimeUs == 0 || imu_stream_moving(&imuBurst[i]))
+            {
+                for (int axis = 0; axis < 3; axis++)
+                    imuMotionReference[axis] = imuBurst[i].accel[axis];
+                imuLastMotionUs = imuTimeUs;
+            }
+        }
+        // Only whole samples, so the consumer never reads half of one. If the consumer is too slow the newest are dropped.
+        size_t fit = xStreamBufferSpacesAvailable(imuStreamBuffer) / sizeof(struct ImuSample);
+        size_t n = (size_t)count < fit ? (size_t)count : fit;
+        if (n > 0)
+            xStreamBufferSend(imuStreamBuffer, imuSamples, n * sizeof(struct ImuSample), 0);
+        pushed += (int)n;
+        // Another full watermark is already waiting -> read it now, its pulse was given while reading
+    } while (remaining >= imuWatermark);
+    // Still for long enough: wait for the next motion in low power
+    if (imuWomThresholdMg != 0 && imuTimeUs - imuLastMotionUs > imuIdleUs)
+        imu_stream_sleep();
+    return pushed;
+}
+
+size_t imu_stream_receive(struct ImuSample *samples, size_t maxSamples, TickType_t timeout)
+{
+    size_t received = xStreamBufferReceive(imuStreamBuffer, samples, maxSamples * sizeof(struct ImuSample), timeout);
+    return received / sizeof(struct ImuSample);
+}
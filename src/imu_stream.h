@@ -0,0 +1,54 @@
+#ifndef IMU_STREAM_H
+#define IMU_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "tkjhat/sdk.h"
+
+// Samples the stream buffer holds between the acquisition task and its consumer
+#define IMU_STREAM_CAPACITY 64
+// Rate of the accelerometer while waiting for motion
+#define IMU_STREAM_WOM_ODR_HZ 50
+// While streaming, a change larger than the wake threshold or a rotation faster than this counts as motion
+#define IMU_STREAM_MOTION_DPS 20
+
+// One raw IMU sample with the time it was measured, counted by the sensor clock
+struct ImuSample
+{
+    uint32_t timeUs;               // Sensor timestamp extended to 32 bit, 0 = first sample after a reset
+    icm42670_fifo_packet_t packet; // Raw accel, gyro and temperature
+};
+
+// Create the stream buffer. watermark is the FIFO watermark given to ICM42670_fifo_enable, the number of
+// samples the sensor interruption announces. Returns false if the buffer cannot be allocated.
+bool imu_stream_init(uint16_t watermark);
+
+// Called by the acquisition task: register it as the task woken by the INT1 interruption and enable it.
+void imu_stream_start(TaskHandle_t acquisitionTask);
+
+// Acquisition task: sleep until INT1 signals a full FIFO watermark (or the timeout passes, in case a pulse
+// was missed), then drain the FIFO into the stream buffer. Returns the number of samples pushed, or a
+// negative value if the sensor could not be read. While the sensor waits for motion, INT1 is the motion
+// interrupt instead: the sensor is woken and 0 is returned.
+int imu_stream_acquire(TickType_t timeout);
+
+// Drop the samples waiting in the sensor FIFO and restart the sample time from 0.
+void imu_stream_reset(void);
+
+// Sleep between gestures: when the samples show no motion for idleMs, the sensor goes to wake-on-motion (low-power
+// accelerometer, gyroscope off, no FIFO) until an axis changes by thresholdMg. Then it streams at full rate again
+// and the sample time restarts from 0. Call it before imu_stream_start. thresholdMg 0 keeps streaming all the time.
+void imu_stream_set_wake_on_motion(uint16_t thresholdMg, uint32_t idleMs);
+
+// Acquisition task: put the sensor in wake-on-motion now, e.g. while the samples are not used.
+// Does nothing if wake-on-motion is not configured.
+void imu_stream_sleep(void);
+
+// Consumer: take up to maxSamples samples, waiting up to timeout for the first one. Returns the number taken.
+size_t imu_stream_receive(struct ImuSample *samples, size_t maxSamples, TickType_t timeout);
+
+#endif
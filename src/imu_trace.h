@@ -0,0 +1,21 @@
+#ifndef IMU_TRACE_H
+#define IMU_TRACE_H
+
+// Text format of a recorded IMU trace, written by the trace output of the firmware (SAMPLE_OUTPUT_TRACE in main.c)
+// or decoded from its binary telemetry (tools/host/telemetry_decode.c), and read by the host replay
+// (tools/host/gesture_replay.c). One reading is:
+//
+//   # imu_trace odr_hz=200 accel_lsb_per_g=8192 gyro_lsb_per_dps_x10=1310
+//   time_us,ax,ay,az,gx,gy,gz,temp,label
+//   0,12,-30,8190,1,-2,0,10,
+//   5000,15,-28,8188,0,-3,1,10,.
+//
+// The values are the raw FIFO counts after the calibration offsets. label is empty in a capture; write '.', '-'
+// or 'S' (shake) on the samples where that gesture is done to measure the detection against it. Lines that are
+// not a sample or the scale line (debug messages of the firmware) are skipped by the replay.
+
+#define IMU_TRACE_SCALE_FORMAT "# imu_trace odr_hz=%u accel_lsb_per_g=%u gyro_lsb_per_dps_x10=%u\n"
+#define IMU_TRACE_COLUMNS "time_us,ax,ay,az,gx,gy,gz,temp,label\n"
+#define IMU_TRACE_SAMPLE_FORMAT "%lu,%d,%d,%d,%d,%d,%d,%d,\n"
+
+#endif
@@ -4,29 +4,84 @@
 #include <FreeRTOS.h>
 #include <queue.h>
 #include <task.h>
+#include <semphr.h>
+#include <event_groups.h>
 #include <string.h>
+#include <stdlib.h>
 #include <pico/cyw43_arch.h>
 #include <math.h>
 
 #include "tkjhat/sdk.h"
+#include "morse.h"
+#include "message_ring.h"
+#include "playback.h"
+#include "serial_rx.h"
+#include "imu_stream.h"
+#include "imu_gestures.h"
+#include "imu_trace.h"
+#include "telemetry.h"
 #include "lwip/tcp.h"
 #include "lwip/pbuf.h"
 #include "lwip/api.h"
 #include "lwip/ip_addr.h"
 #include "lwip/err.h"
 
-#define INPUT_BUFFER_SIZE 502
-#define MORSE_ALPHABET_SIZE 40
 #define SONG_TONE_SIZE 25
-#define WINDOW_SIZE 9
-#define MORSE_CHARACTER_SIZE 7
+// Beep announcing a sent or received message
+#define FEEDBACK_TONE_HZ 640
+#define FEEDBACK_TONE_MS 500
+// Longest wait for the announcement beep before a playback: it can queue after other tones or be dropped
+#define FEEDBACK_WAIT_MS (FEEDBACK_TONE_MS + 500)
+// Text line of the lcd: the letters scroll in from the right, 2 pixels every 40 ms (50 pixels per second)
+#define LCD_WIDTH 128
+#define LCD_TICKER_STEP_PX 2
+#define LCD_TICKER_STEP_MS 40
+// Blank pixels left and right of the text
+#define LCD_TICKER_MARGIN 8
+// Letters kept on the line, the older ones have scrolled out of the display
+#define LCD_TICKER_LETTERS 32
+#define TRANSLATED_QUEUE_LENGTH 64
+#define EVENT_QUEUE_LENGTH 16
+// Speed of the buzzer, rgb and lcd playback (PARIS words per minute)
+#define MORSE_PLAYBACK_WPM MORSE_DEFAULT_WPM
 #define LIGHT_THRESHOLD 3
+// IMU samples are streamed through the sensor FIFO and drained in bursts of IMU_FIFO_WATERMARK packets
+#define IMU_FIFO_ODR_HZ IMU_GESTURES_ODR_HZ
+#define IMU_FIFO_WATERMARK 16
+#define IMU_FIFO_PERIOD_MS (IMU_FIFO_WATERMARK * 1000 / IMU_FIFO_ODR_HZ)
+// Read the FIFO anyway if no INT1 pulse came for 2 bursts
+#define IMU_INT_TIMEOUT_MS (2 * IMU_FIFO_PERIOD_MS)
+// After 3 s without motion the sensor sleeps (low-power accelerometer, gyroscope off) until it moves by 60 mg
+#define IMU_WOM_THRESHOLD_MG 60
+#define IMU_WOM_IDLE_MS 3000
+// Samples averaged at boot to measure the sensor offsets (0.5 s lying still)
+#define IMU_CALIBRATION_SAMPLES (IMU_FIFO_ODR_HZ / 2)
+// Output of the IMU and light sensor samples on the usb serial. Formatting text costs the tasks more than reading
+// the sensors, so the readable logs are only built on demand:
+// SAMPLE_OUTPUT_LOG       -> readable log, the IMU decimated to 20 Hz (default, the text the serial client reads)
+// SAMPLE_OUTPUT_TELEMETRY -> binary frames (telemetry_format.h), tools/host/telemetry_decode turns them into CSV.
+//                            About 4.8 KB/s of binary on the same usb serial: the text serial client cannot be used
+// SAMPLE_OUTPUT_TRACE     -> every IMU sample as a trace line (imu_trace.h) for the host replay
+// SAMPLE_OUTPUT_NONE      -> nothing but the events
+#define SAMPLE_OUTPUT_NONE 0
+#define SAMPLE_OUTPUT_TELEMETRY 1
+#define SAMPLE_OUTPUT_TRACE 2
+#define SAMPLE_OUTPUT_LOG 3
+#define SAMPLE_OUTPUT SAMPLE_OUTPUT_LOG
+// Every sample goes through the gesture rules, only every 10th one is logged (20 Hz)
+#define IMU_LOG_DECIMATION (IMU_FIFO_ODR_HZ / 20)
+// The telemetry writer only runs when the sensor tasks are blocked
+#define TELEMETRY_TASK_PRIORITY 1
 #define TEST_TCP_SERVER_IP "51.20.8.40"
 #if !defined(TEST_TCP_SERVER_IP)
 #error TEST_TCP_SERVER_IP not defined
 #endif
 
 #define TCP_PORT 8080
+// 0 -> send the IMU message as morse text ending with '\n' (what the server and the serial client read)
+// 1 -> send it bit-packed (morse_packed_serialize(): symbol count, then 2 bits per symbol, no '\n'), only for a
+//      server that decodes that format
+#define TCP_SEND_PACKED_MORSE 0
 #define DEBUG_printf printf
 #define BUF_SIZE 502
 
@@ -55,21 +110,28 @@ enum state
     WAITING_DATA,
     DATA_READY,
     SEND_DATA,
-    SPACES_REQUIREMENTS_SATISFIED,
-    DISPLAY,
-    DISPLAY_FINISHED
+    SPACES_REQUIREMENTS_SATISFIED
 };
-// Starting with IDLE state
-enum state programState = IDLE;
+// Starting with IDLE state. Only the state machine task writes it, the other tasks send events.
+volatile enum state programState = IDLE;
 
-// Struct type for morse character alphabet
-struct MorseAlphabet
+// Events that drive the state machine, sent from the button interruption and the tasks
+enum event
 {
-    char morseCode[MORSE_CHARACTER_SIZE];
-    char letter;
-    int currMorseCodeIndex;
+    EVENT_BUTTON1 = 1,      // Start reading the IMU
+    EVENT_SPACE,            // Button2 or light sensor: space, or send after 2 spaces
+    EVENT_DOT,              // IMU gesture for '.'
+    EVENT_DASH,             // IMU gesture for '-'
+    EVENT_SHAKE,            // IMU shaken, the music was played
+    EVENT_SEND_DONE         // Message sent to the serial client and tcp server
 };
 
+// Event group bits the tasks block on, set by the state machine on each transition
+#define APP_BIT_IMU_ENABLED (1 << 0)   // WAITING_DATA: imu task reads the sensor
+#define APP_BIT_SPACE_ENABLED (1 << 1) // DATA_READY or SPACES_REQUIREMENTS_SATISFIED: light sensor is read
+#define APP_BIT_SEND_REQUEST (1 << 2)  // SEND_DATA: one shot for the send task
+#define APP_STATE_BITS (APP_BIT_IMU_ENABLED | APP_BIT_SPACE_ENABLED)
+
 // Struct type for the tcp client
 typedef struct TCP_CLIENT_T_
 {
@@ -83,96 +145,98 @@ typedef struct TCP_CLIENT_T_
     bool connected; // To check if the client is connected to server.
 } TCP_CLIENT_T;
 
-// Morse alphabet to be searched.
-struct MorseAlphabet morseCodes[MORSE_ALPHABET_SIZE] = {
-    {".-", 'a'},
-    {"-...", 'b'},
-    {"-.-.", 'c'},
-    {"-..", 'd'},
-    {".", 'e'},
-    {"..-.", 'f'},
-    {"--.", 'g'},
-    {"....", 'h'},
-    {"..", 'i'},
-    {".---", 'j'},
-    {"-.-", 'k'},
-    {".-..", 'l'},
-    {"--", 'm'},
-    {"-.", 'n'},
-    {"---", 'o'},
-    {".--.", 'p'},
-    {"--.-", 'q'},
-    {".-.", 'r'},
-    {"...", 's'},
-    {"-", 't'},
-    {"..-", 'u'},
-    {"...-", 'v'},
-    {".--", 'w'},
-    {"-..-", 'x'},
-    {"-.--", 'y'},
-    {"--..", 'z'},
-    {"-----", '0'},
-    {".----", '1'},
-    {"..---", '2'},
-    {"...--", '3'},
-    {"....-", '4'},
-    {".....", '5'},
-    {"-....", '6'},
-    {"--...", '7'},
-    {"---..", '8'},
-    {"----.", '9'},
-    {".-.-.-", '.'},
-    {"--..--", ','},
-    {"..--..", '?'},
-    {"-.-.--", '!'},
-};
+// Global pointer variable to manage the client.
+TCP_CLIENT_T *clientState = NULL;
+// Orientation filter and gesture rules, compiled for the sensor full-scale ranges
+struct ImuGestures imuGestures;
 
-// Data structure for morse messagees
-struct Message
+// Initialize the variable to store the morse code received from IMU (2 bits per symbol) with default value = 0.
+struct MorsePacked imuMorseMessage = {0};
+// Initialize the variable to store the serial received morse message (2 bits per symbol) with default value = 0
+struct MorsePacked serialReceivedMorseMessage = {0};
+// Decoder state of the serial received message, fed one morse character at a time.
+struct MorseDecoder serialMorseDecoder = {MORSE_TRIE_ROOT};
+// Kind of the items sent to the lcd task
+enum lcdItemKind
 {
-    char lastReadCharacter;          // Last read morse character
-    int currentIndex;                // Current index in the morse string
-    char message[INPUT_BUFFER_SIZE]; // Strring to store the morse received.
+    LCD_PREVIEW_LETTER = 1, // Letter decoded while the message is received
+    LCD_PREVIEW_END,        // The received message is complete
+    LCD_PLAYBACK_START,     // The timeline starts playing a message
+    LCD_PLAYBACK_LETTER,    // Letter of the message being played, sent from the timer interruption
+    LCD_PLAYBACK_END        // The timeline finished the message
 };
-
-// Struct type for storing the temperature value, and to get the threshold
-struct InitialTemp
+struct LcdItem
 {
-    float temp;     // To store the first temperature value get
-    int isFirstGet; // Boolean to check if the first value is stored or not
+    uint8_t kind;
+    char letter;
 };
-
-// Global pointer variable to manage the client.
-TCP_CLIENT_T *clientState = NULL;
-// Initialize the temperature threshold with the value 0.
-struct InitialTemp tempThreshold = {0};
-
-// Initialize the variable to store the morse code received from IMU with default value = 0.
-struct Message imuMorseMessage = {0};
-// Initialize the variable to store the serial received morse message with default value = 0
-struct Message serialReceivedMorseMessage = {0};
-// Initialize the variable to store the translated message of the serial received message.
-struct Message translatedMessage = {0};
+// Text line of the lcd, scrolled until its end is on the display
+struct LcdTicker
+{
+    char text[LCD_TICKER_LETTERS + 1];
+    int length;
+    int32_t offset; // Pixel of the text at the left edge of the display
+};
+// Queue of lcd items: letters decoded from the serial message as they arrive and letters of the playback.
+QueueHandle_t translatedLetterQueue = NULL;
+// Queue of events (enum event) for the state machine task.
+QueueHandle_t appEventQueue = NULL;
+// Event group to wake the tasks when the state machine enables their work.
+EventGroupHandle_t appEventGroup = NULL;
+// Consumers of the display ring, each one gets every received message
+enum displayConsumer
+{
+    DISPLAY_CONSUMER_PLAYBACK = 0,
+    DISPLAY_CONSUMER_COUNT
+};
+// Task playing the messages, notified by the timer interruption when a message ends.
+TaskHandle_t playbackTaskHandle = NULL;
+// Given by the buzzer driver when the announcement beep before a playback ended.
+SemaphoreHandle_t feedbackDoneSemaphore = NULL;
+// Received messages as timed (on, off) schedules, computed once and played by the buzzer, rgb and lcd.
+// A new message can be received while the previous ones are still playing.
+struct MessageRing displayRing;
+// Text line received from the tcp server, waiting to be encoded by the serial receive task.
+char tcpReceivedText[BUF_SIZE];
+volatile int tcpReceivedTextLength = 0;
+volatile bool tcpReceivedTextReady = false;
 // Variable of tick type to check the last time the user click the button.
 volatile TickType_t lastButtonTick = 0;
 
 // Prototype for functions
 // Function to receive daata from IMU sensor (Accelerometer and GyroScope) (Task)
 void imu_task(void *pvParameters);
+void imu_gesture_task(void *pvParameters);
 // Function to send the morse string to the serial monitor. (Task)
 static void handle_send_task(void *arg);
 // Function to be called when button interruption appear (Interruption)
 static void btn_fxn(uint gpio, uint32_t eventMask);
 // Function to convert data from IMU to morse character
-void handle_imu_data(float *ax, float *ay, float *az, float *gx, float *gy, float *gz, float *temp);
-// Function to display the morse code by the rgb task (Task)
-void rgb_task(void *pvParameters);
-// Function to display the morse code by the buzzer (Task)
-void buzzer_task(void *pvParameters);
-// Function to translate the serial received morse message to become normal alphabet.
-void translate_receives_morse_codes(void);
-// Function to find the correct letter from the morse code
-char find_letter_from_morse_code(char *morseCode);
+void handle_imu_data(const struct GestureRule *gesture);
+static void gesture_engine_init(void);
+static void imu_calibration_init(void);
+// Functions to send the IMU samples to the host in the SAMPLE_OUTPUT format
+static void imu_output_start(void);
+static void imu_output_sample(const struct ImuSample *sample, const struct OrientationAngles *orientation);
+// Function to play the received messages on the buzzer, rgb and lcd from one timer (Task)
+static void playback_task(void *pvParameters);
+// Functions called from the playback timer interruption.
+static void playback_letter_from_isr(char letter);
+static void playback_finished_from_isr(void);
+// Function called by the buzzer driver when the announcement beep ended.
+static void feedback_done_from_isr(void *userData);
+// Function to decode one serial received morse character and pass the decoded letters to the lcd.
+static void stream_serial_morse_character(char character);
+// Function to pass one received text character to the lcd.
+static void stream_text_character(char character);
+// Function to finish the received message: build its schedule and hand it to the display tasks.
+static void finish_received_message(struct MessageSlot *slot, bool textMessage);
+// Functions to add a letter to a text line of the lcd, to empty it and to scroll it.
+static void lcd_ticker_push(struct LcdTicker *ticker, char letter);
+static void lcd_ticker_clear(struct LcdTicker *ticker);
+static bool lcd_ticker_step(struct LcdTicker *ticker, const char *placeholder);
+// Function to show a text line on the lcd, or the placeholder if it is empty.
+static void lcd_ticker_show(const struct LcdTicker *ticker, const char *placeholder);
 // Function to send the feedback by buzzer when the morse message is sent to serial client
 void sending_feedback();
 // Function to play the music.
@@ -181,16 +245,22 @@ static void buzzer_music_play();
 static void lcd_display_task(void *pvParameters);
 // Function to receive the string from the serial client.
 static void serial_receive_task(void *arg);
-// Function to control or to know if the display task from 3 thing: buzzer, rgb, lcd is displayed or not.
-static void display_controller_task(void *args);
+// Function to run the state machine: take the events one by one and do the transitions (Task).
+static void state_machine_task(void *args);
+// Function to change the state and wake the tasks waiting for it.
+static void set_state(enum state newState);
+// Function to send an event to the state machine from a task.
+static void post_event(enum event appEvent);
 // Function to connect to the wifi.
 void wirelessTask();
 // Function to connect to the remote tcp server
 void connect_to_tcp(void);
 // Function to send the data to the tcp server
 void send_data_tcp();
-// Function to add the character to the string and update the index.
-void add_character_to_string(struct Message *message, char character, int updatedIndex);
+// Function to add the morse character ('.', '-', ' ') to the packed message.
+bool add_character_to_message(struct MorsePacked *message, char character);
+// Function to check if the last added symbol of the message is a single space.
+static bool message_ends_with_space(const struct MorsePacked *message);
 // prototype for light sensor
 void light_sensor_task(void *pvParameters);
 
@@ -219,6 +289,11 @@ int main()
     rgb_led_write(0, 0, 0);
     // Initialize the buzzer
     init_buzzer();
+    // Initialize the timeline that plays the received messages on the buzzer, rgb and lcd
+    if (!playback_init(playback_letter_from_isr, playback_finished_from_isr))
+    {
+        printf("__No hardware alarm free for the playback__\n");
+    }
     // Initialize light sensor
     init_veml6030();
     // Initialize the display
@@ -233,39 +308,70 @@ int main()
         {
             printf("__ICM42670P cound not initialize the accelerometer or gyroscope__\n");
         }
+        // Sample faster and let the sensor FIFO buffer the samples between 2 bursts
+        else if (ICM42670_startAccel(IMU_FIFO_ODR_HZ, ICM42670_ACCEL_FSR_DEFAULT) != 0 ||
+                 ICM42670_startGyro(IMU_FIFO_ODR_HZ, ICM42670_GYRO_FSR_DEFAULT) != 0 ||
+                 ICM42670_fifo_enable(IMU_FIFO_WATERMARK) != 0)
+        {
+            printf("__ICM42670P cound not enable the FIFO__\n");
+        }
+        gesture_engine_init();
+        imu_calibration_init();
     }
     else
     {
         printf("__ICM42670 could not be initialized__\n");
     }
-    // Set the interruption for both button1, button2 using together btn_fxn function.
-    gpio_set_irq_enabled_with_callback(BUTTON1, GPIO_IRQ_EDGE_RISE, true, btn_fxn);
-    gpio_set_irq_enabled(BUTTON2, GPIO_IRQ_EDGE_RISE, true);
     // TaskHandle for handle_send_task function
     TaskHandle_t serialSendTask;
     // TaskHandle for imu_task function
     TaskHandle_t hIMUTask = NULL;
+    // TaskHandle for imu_gesture_task function
+    TaskHandle_t hGestureTask = NULL;
     // TaskHandle for ambient_light function
     TaskHandle_t hLightTask = NULL;
-    // TaskHandle for the buzzer display function
-    TaskHandle_t buzzerTask = NULL;
-    // Task handle for displaying by rgb.
-    TaskHandle_t rgbTask = NULL;
     // TaskHandle for displaying on the lcd.
     TaskHandle_t lcdDisplay = NULL;
     // TaskHandle for the receiving morse message from the serial_client
     TaskHandle_t serialReceiveTask = NULL;
-    // TaskHandle for controlling the 3 display task: buzzer, rgb, lcd.
-    TaskHandle_t displayControllerTask = NULL;
+    // TaskHandle for the state machine.
+    TaskHandle_t stateMachineTask = NULL;
+    // Queue for the letters decoded from the serial client, created before the tasks that use it.
+    translatedLetterQueue = xQueueCreate(TRANSLATED_QUEUE_LENGTH, sizeof(struct LcdItem));
+    // Queue and event group of the state machine, created before the button interruption can use them.
+    appEventQueue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(uint8_t));
+    appEventGroup = xEventGroupCreate();
+    feedbackDoneSemaphore = xSemaphoreCreateBinary();
+    // Ring of received messages read by the playback task (one consumer, DISPLAY_CONSUMER_COUNT)
+    if (!message_ring_init(&displayRing, DISPLAY_CONSUMER_COUNT))
+    {
+        printf("__Display ring could not be created__\n");
+    }
+    // Stream of the IMU samples from imu_task to imu_gesture_task
+    if (!imu_stream_init(IMU_FIFO_WATERMARK))
+    {
+        printf("__IMU stream could not be created__\n");
+    }
+#if SAMPLE_OUTPUT == SAMPLE_OUTPUT_TELEMETRY
+    // Ring and writer task of the binary sample frames
+    if (!telemetry_init(TELEMETRY_TASK_PRIORITY))
+    {
+        printf("__Telemetry could not be created__\n");
+    }
+#endif
+    // Set the interruption for both button1, button2 using together btn_fxn function.
+    gpio_set_irq_enabled_with_callback(BUTTON1, GPIO_IRQ_EDGE_RISE, true, btn_fxn);
+    gpio_set_irq_enabled(BUTTON2, GPIO_IRQ_EDGE_RISE, true);
     // Create and schedule all task above.
     xTaskCreate(handle_send_task, "serialSendTask", 1024, NULL, 2, &serialSendTask);
-    xTaskCreate(display_controller_task, "displayControllerTask", 1024, NULL, 2, &displayControllerTask);
-    xTaskCreate(rgb_task, "RGBTask", 256, (void *)displayControllerTask, 2, &rgbTask);
-    xTaskCreate(buzzer_task, "BuzzerTask", 1024, (void *)displayControllerTask, 2, &buzzerTask);
-    xTaskCreate(imu_task, "IMUTask", 1024, NULL, 3, &hIMUTask);
+    // The state machine has the highest priority so an event is handled right after it is sent.
+    xTaskCreate(state_machine_task, "stateMachineTask", 1024, NULL, 4, &stateMachineTask);
+    xTaskCreate(playback_task, "PlaybackTask", 512, NULL, 2, &playbackTaskHandle);
+    xTaskCreate(imu_task, "IMUTask", 512, NULL, 3, &hIMUTask);
+    xTaskCreate(imu_gesture_task, "GestureTask", 1024, NULL, 2, &hGestureTask);
     xTaskCreate(light_sensor_task, "LightTask", 512, NULL, 2, &hLightTask);
     xTaskCreate(serial_receive_task, "serialReceiveTask", 1024, NULL, 2, &serialReceiveTask);
-    xTaskCreate(lcd_display_task, "lcdTask", 1024, (void *)displayControllerTask, 2, &lcdDisplay);
+    xTaskCreate(lcd_display_task, "lcdTask", 1024, NULL, 2, &lcdDisplay);
     // xTaskCreate(wirelessTask, "WirelessTask", 1024, NULL, 2,NULL );
     // Start to run and schedule the task
     vTaskStartScheduler();
@@ -277,49 +383,172 @@ void imu_task(void *pvParameters)
 {
     (void)pvParameters;
 
-    // Variabble to store imu data received.
-    float ax, ay, az, gx, gy, gz, temp;
-    // Variable keeps track of when the task was last unblocked
-    TickType_t xLastWakeTime;
-    xLastWakeTime = xTaskGetTickCount();
+    // The INT1 interruption of the sensor wakes this task when a FIFO burst is ready, or when the board moves
+    imu_stream_set_wake_on_motion(IMU_WOM_THRESHOLD_MG, IMU_WOM_IDLE_MS);
+    imu_stream_start(xTaskGetCurrentTaskHandle());
     while (1)
     {
-        // Read the data received from Accelerometer and Gyroscope
-        // Only read if the programState equal WAITING_DATA
-        if (programState == WAITING_DATA)
+        // Only read in WAITING_DATA, otherwise block (no polling) until button1 enables the reading
+        if ((xEventGroupGetBits(appEventGroup) & APP_BIT_IMU_ENABLED) == 0)
         {
-            // Read the data from the sensor
-            if (ICM42670_read_sensor_data(&ax, &ay, &az, &gx, &gy, &gz, &temp) == 0)
-            {
-                printf("__Accel: X=%f, Y=%f, Z=%f | Gyro: X=%f, Y=%f, Z=%f| Temp: %2.2f°C  threshold: %2.2f°C__\n", ax, ay, az, gx, gy, gz, temp, tempThreshold.temp);
-                // If this the first time reading the IMU sensor.
-                if (tempThreshold.isFirstGet == 0)
-                {
-                    // Change the value isFirstGet to announce that we have get the first temperature value
-                    tempThreshold.isFirstGet = 1;
-                    // Store the first received temperature to be the threshold
-                    tempThreshold.temp = temp;
-                }
+            // Nobody uses the samples: low power until the reading is enabled and the board moves
+            imu_stream_sleep();
+            xEventGroupWaitBits(appEventGroup, APP_BIT_IMU_ENABLED, pdFALSE, pdTRUE, portMAX_DELAY);
+            // Drop the samples stored while the reading was disabled
+            imu_stream_reset();
+        }
+        // Sleep until the sensor has a burst, then push its samples to the gesture task
+        if (imu_stream_acquire(pdMS_TO_TICKS(IMU_INT_TIMEOUT_MS)) < 0)
+        {
+            printf("__Failed to read data from IMU sensor__\n");
+        }
+    }
+}
+
+void imu_gesture_task(void *pvParameters)
+{
+    (void)pvParameters;
 
-                // Function to handle imu data
-                handle_imu_data(&ax, &ay, &az, &gx, &gy, &gz, &temp);
+    // Samples taken from the stream in one go
+    struct ImuSample samples[IMU_FIFO_WATERMARK];
+    while (1)
+    {
+        size_t count = imu_stream_receive(samples, IMU_FIFO_WATERMARK, portMAX_DELAY);
+        for (size_t i = 0; i < count; i++)
+        {
+            // The time restarts from 0 when the reading starts again: forget the samples of the last reading
+            if (samples[i].timeUs == 0)
+            {
+                imu_gestures_reset(&imuGestures);
+                imu_output_start();
             }
-            else
+            struct OrientationAngles orientation;
+            const struct GestureRule *gesture = imu_gestures_process(&imuGestures, &samples[i].packet, &orientation);
+            imu_output_sample(&samples[i], &orientation);
+
+            // Function to handle imu data
+            if (gesture != NULL)
             {
-                printf("__Failed to read data from IMU sensor__\n");
+                handle_imu_data(gesture);
             }
         }
+    }
+}
+
+static void imu_output_start(void)
+{
+#if SAMPLE_OUTPUT == SAMPLE_OUTPUT_TELEMETRY || SAMPLE_OUTPUT == SAMPLE_OUTPUT_TRACE
+    // Rate and ranges of the raw samples that follow
+    icm42670_scale_t scale;
+    ICM42670_get_scale(&scale);
+#if SAMPLE_OUTPUT == SAMPLE_OUTPUT_TELEMETRY
+    uint8_t payload[TELEMETRY_IMU_SCALE_SIZE];
+    uint8_t *out = telemetry_put_u16(payload, IMU_FIFO_ODR_HZ);
+    out = telemetry_put_u16(out, scale.accel_lsb_per_g);
+    telemetry_put_u16(out, scale.gyro_lsb_per_dps_x10);
+    telemetry_send(TELEMETRY_IMU_SCALE, payload, sizeof(payload));
+#else
+    printf(IMU_TRACE_SCALE_FORMAT IMU_TRACE_COLUMNS, IMU_FIFO_ODR_HZ, scale.accel_lsb_per_g, scale.gyro_lsb_per_dps_x10);
+#endif
+#endif
+}
+
+static void imu_output_sample(const struct ImuSample *sample, const struct OrientationAngles *orientation)
+{
+    const icm42670_fifo_packet_t *packet = &sample->packet;
+#if SAMPLE_OUTPUT == SAMPLE_OUTPUT_TELEMETRY
+    // No formatting: the raw counts are copied into the frame as they are
+    (void)orientation;
+    uint8_t payload[TELEMETRY_IMU_SAMPLE_SIZE];
+    uint8_t *out = telemetry_put_u32(payload, sample->timeUs);
+    for (int axis = 0; axis < 3; axis++)
+        out = telemetry_put_u16(out, (uint16_t)packet->accel[axis]);
+    for (int axis = 0; axis < 3; axis++)
+        out = telemetry_put_u16(out, (uint16_t)packet->gyro[axis]);
+    *out = (uint8_t)packet->temperature;
+    telemetry_send(TELEMETRY_IMU_SAMPLE, payload, sizeof(payload));
+#elif SAMPLE_OUTPUT == SAMPLE_OUTPUT_TRACE
+    (void)orientation;
+    printf(IMU_TRACE_SAMPLE_FORMAT, (unsigned long)sample->timeUs, packet->accel[0], packet->accel[1], packet->accel[2],
+           packet->gyro[0], packet->gyro[1], packet->gyro[2], packet->temperature);
+#elif SAMPLE_OUTPUT == SAMPLE_OUTPUT_LOG
+    // Counts the samples to log one every IMU_LOG_DECIMATION
+    static uint32_t sampleCount = 0;
+    if (++sampleCount % IMU_LOG_DECIMATION == 0)
+    {
+        printf("__%lu us Accel: X=%d, Y=%d, Z=%d | Gyro: X=%d, Y=%d, Z=%d| Temp: %d threshold: %d (raw counts) | Roll: %d Pitch: %d Yaw: %d (0.01 deg)__\n", (unsigned long)sample->timeUs,
+               packet->accel[0], packet->accel[1], packet->accel[2], packet->gyro[0], packet->gyro[1], packet->gyro[2],
+               packet->temperature, imuGestures.tempBaseline, orientation->roll, orientation->pitch, orientation->yaw);
+    }
+#else
+    (void)packet;
+    (void)orientation;
+#endif
+}
+
+static void imu_calibration_init(void)
+{
+    // Offsets of an earlier boot, used if the board is moved now
+    icm42670_offsets_t stored;
+    bool haveStored = ICM42670_load_offsets(&stored) == 0;
+    icm42670_offsets_t offsets;
+    int rc = ICM42670_calibrate(IMU_CALIBRATION_SAMPLES, haveStored ? &stored : NULL, &offsets);
+    if (rc != 0)
+    {
+        if (haveStored)
+        {
+            printf("__IMU not calibrated (%d), using the stored offsets__\n", rc);
+            ICM42670_set_offsets(&stored);
+        }
+        else
+        {
+            printf("__IMU not calibrated (%d), keep the board still at boot__\n", rc);
+        }
+        return;
+    }
+    ICM42670_set_offsets(&offsets);
+    printf("__IMU offsets Accel: X=%d, Y=%d, Z=%d | Gyro: X=%d, Y=%d, Z=%d (raw counts)__\n",
+           offsets.accel[0], offsets.accel[1], offsets.accel[2], offsets.gyro[0], offsets.gyro[1], offsets.gyro[2]);
+    // Only write the flash when the stored offsets are missing, for other ranges, or from another temperature
+    // (then they taught the gyroscope drift)
+    if (!haveStored || stored.scale.accel_lsb_per_g != offsets.scale.accel_lsb_per_g ||
+        stored.scale.gyro_lsb_per_dps_x10 != offsets.scale.gyro_lsb_per_dps_x10 ||
+        abs(offsets.temperature - stored.temperature) >= ICM42670_CALIB_TC_MIN_DELTA)
+    {
+        if (ICM42670_save_offsets(&offsets) != 0)
+        {
+            printf("__IMU offsets could not be stored__\n");
+        }
+    }
+    // The temperature gestures compare with the temperature measured while lying still, not the first sample
+    imu_gestures_set_temperature_baseline(&imuGestures, offsets.temperature);
+}
 
-        // Stop 100ms to run other tasks.
-        vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(50));
+static void gesture_engine_init(void)
+{
+    // Sensitivity of the full-scale ranges the sensor was started with
+    icm42670_scale_t scale;
+    ICM42670_get_scale(&scale);
+    if (!imu_gestures_init(&imuGestures, &scale))
+    {
+        printf("__Gesture rules could not be compiled__\n");
     }
 }
-void add_character_to_string(struct Message *message, char character, int updatedIndex)
+bool add_character_to_message(struct MorsePacked *message, char character)
 {
-    // Function to add the character to the current index
-    message->message[message->currentIndex] = character;
-    // Increase the value of the current index
-    message->currentIndex = updatedIndex;
+    // Pack the character as a 2 bit symbol, a second space in a row becomes a word gap
+    if (!morse_packed_append_char(message, character))
+    {
+        printf("__Cannot add morse character '%c'__\n", character);
+        return false;
+    }
+    return true;
+}
+
+static bool message_ends_with_space(const struct MorsePacked *message)
+{
+    // An empty message has no last symbol
+    return morse_packed_last(message) == MORSE_SYMBOL_LETTER_GAP;
 }
 
 static void handle_send_task(void *arg)
@@ -328,24 +557,26 @@ static void handle_send_task(void *arg)
 
     while (1)
     {
-        // If the progrramState is SEND_DATA -> Send the morsee string to serial monitor.
-        if (programState == SEND_DATA)
+        // Block until the state machine enters SEND_DATA -> Send the morsee string to serial monitor.
+        if (xEventGroupWaitBits(appEventGroup, APP_BIT_SEND_REQUEST, pdTRUE, pdTRUE, portMAX_DELAY) & APP_BIT_SEND_REQUEST)
         {
             // Announce that we have send data with the buzzer sound
             sending_feedback();
-            // Send the morse string to the serial client
-            printf("__Receive morse message %s __\n", imuMorseMessage.message);
+            // Send the morse string to the serial client (unpacked to text only for printing)
+            char morseText[MORSE_PACKED_TEXT_MAX];
+            morse_packed_to_text(&imuMorseMessage, morseText, sizeof(morseText));
+            printf("__Receive morse message %s\n __\n", morseText);
+            // Translate only the imuMorseMessage.count symbols of the message
+            char translated[MORSE_PACKED_CAPACITY + 1];
+            size_t translatedLength = morse_packed_translate(&imuMorseMessage, translated, sizeof(translated));
+            printf("__Translated message (%u letters) %s__\n", (unsigned)translatedLength, translated);
             // Send the morse string to the tcp server
             send_data_tcp();
-            // Reset the morse string index = 0
             // Reset the morse string to be empty.
-            imuMorseMessage.currentIndex = 0;
-            add_character_to_string(&imuMorseMessage, '\0', 0);
-            // Set the programState to be IDLE
-            programState = IDLE;
+            morse_packed_clear(&imuMorseMessage);
+            // Tell the state machine to go back to IDLE
+            post_event(EVENT_SEND_DONE);
         }
-        // Stop 100ms to run other tasks
-        vTaskDelay(pdMS_TO_TICKS(100));
     }
 }
 
@@ -361,310 +592,144 @@ static void btn_fxn(uint gpio, uint32_t eventMask)
     }
     // Update the last tick time of the button
     lastButtonTick = now;
-    // Check if the button pressed is button1 or button2
-    if (gpio == BUTTON1)
-    {
-        // If programState is not DISPLAY
-        if (programState != DISPLAY)
-        {
-            // If button1 -> set the state to WAITING_DATA to received IMU sensor data
-            programState = WAITING_DATA;
-            printf("__Start to read sensor data__\n");
-        }
-        else
-        {
-            printf("__ Already in display mode, please wait until finished__\n");
-        }
-    }
-    else if (gpio == BUTTON2)
-    {
-        // If button2 -> first check if there are 2 consecutive spaces already.
-        if (programState == SPACES_REQUIREMENTS_SATISFIED)
-        {
-            // If there are 2 consecutive spaces -> set the current position element in morse string to be \n.
-            // Increase the index by 1
-            add_character_to_string(&imuMorseMessage, '\n', imuMorseMessage.currentIndex + 1);
-            // Set the current position element in morse string to be \0 to stop the string
-            add_character_to_string(&imuMorseMessage, '\0', 0);
-            // Set the programState to be SEND_DATA to send it to serial monitor and tcp server
-            programState = SEND_DATA;
-        }
-        else if (programState == DATA_READY)
-        {
-            printf("__Send space__\n");
-            // Check if there is already 1 space before the current index.
-            if (imuMorseMessage.message[imuMorseMessage.currentIndex - 1] == ' ')
-            {
-                // If it is, then set the programState to announce that we are in the state of 2 consecutive spaces.
-                printf("__2 space consecutively detected__\n");
-                programState = SPACES_REQUIREMENTS_SATISFIED;
-            }
-            // If we just received a morse character from imu and there exists no 2 consecutive spaces
-            // Then we put a space in the current position in morse string
-            add_character_to_string(&imuMorseMessage, ' ', imuMorseMessage.currentIndex + 1);
-        }
-        else
-        {
-            printf("__Unavailble to send the space here__\n");
-        }
-    }
+    // Only send the event here, the state machine task does the transition right after this interruption
+    uint8_t appEvent = (gpio == BUTTON1) ? EVENT_BUTTON1 : EVENT_SPACE;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xQueueSendFromISR(appEventQueue, &appEvent, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
-void handle_imu_data(float *ax, float *ay, float *az, float *gx, float *gy, float *gz, float *temp)
+void handle_imu_data(const struct GestureRule *gesture)
 {
-    if (fabs(*gx) > 200 && fabs(*gy) > 200 && fabs(*gz) > 200)
+    char symbol = imu_gestures_symbol(gesture);
+    if (symbol == 0)
     {
         // If we shake the device, the music will be played
         buzzer_music_play();
-        // Set the programState back to IDLE
-        programState = IDLE;
-    }
-    else if (*gx < -200 && fabs(*gz) < 110 && fabs(*gy) < 110)
-    {
-        // If the device's head is moved fast from down to up -> set the current position of the morse string to be a dot.
-        // Increase the morse string index by 1
-        add_character_to_string(&imuMorseMessage, '.', imuMorseMessage.currentIndex + 1);
-        printf("__Received Morse character '.' with moving the head down to up and go back to DATA_READY__\n");
-        // Set the programState to be DATA_READY to be able to send space
-        programState = DATA_READY;
-    }
-    else if (fabs(*gx) < 70 && *gy > 200 && fabs(*gz) < 70)
-    {
-        // If the device is tilt left fast -> set the current position of the morse string to be a dash.
-        // Increase the morse string index by 1
-        add_character_to_string(&imuMorseMessage, '-', imuMorseMessage.currentIndex + 1);
-        printf("__Received Morse character '-' with tilt left fast and go back to DATA_READY__\n");
-        // Set the programState to be DATA_READY to be able to send space
-        programState = DATA_READY;
-    }
-    else if ((*ax > -1.1 && *ax < -0.9) && (*ay > -0.1 && *ay < 0.1) && (*az > -0.1 && *az < 0.1) && *temp > tempThreshold.temp + 1)
-    {
-        // If the position of imu is place left tilt position and the temp > tempthreshold + 1 -> set the current position of the morse string to be a dot.
-        // Increase the morse string index by 1
-        add_character_to_string(&imuMorseMessage, '.', imuMorseMessage.currentIndex + 1);
-        printf("__Received Morse character '.' with tilt left and increase the temperature and go back to DATA_READY__\n");
-        // Set the programState to be DATA_READY to be able to send space
-        programState = DATA_READY;
-    }
-    else if ((*ax > 0.9 && *ax < 1.1) && (*ay > -0.1 && *ay < 0.1) && (*az > -0.1 && *az < 0.1) && *temp > tempThreshold.temp + 1)
-    {
-        // If the position of imu is place right tilt position and the temp > tempthreshold + 1  -> set the current position of the morse string to be a dash.
-        // Increase the morse string index by 1
-        add_character_to_string(&imuMorseMessage, '-', imuMorseMessage.currentIndex + 1);
-        printf("__Received Morse character '-' with tilt right and increase the temperature and go back to DATA_READY__\n");
-        // Set the programState to be DATA_READY to be able to send space
-        programState = DATA_READY;
-    }
-    // Check if the position of the IMU sensor match the condition
-    if ((*ax > -0.1 && *ax < 0.1) && (*ay > -0.1 && *ay < 0.1) && (*az > 0.9 && *az < 1.1))
-    {
-        // If the position of imu is place horizontally -> set the current position of the morse string to be a dot.
-        // Increase the morse string index by 1
-        add_character_to_string(&imuMorseMessage, '.', imuMorseMessage.currentIndex + 1);
-        printf("__Received Morse character '.' and go back to DATA_READY__\n");
-        // Set the programState to be DATA_READY to be able to send space
-        programState = DATA_READY;
     }
-    else if ((*ax > -0.1 && *ax < 0.1) && (*az > -0.1 && *az < 0.1) && (*ay < -0.9 && *ay > -1.1))
+    else
     {
-        // If the position of imu is place horizontally -> set the current position of the morse string to be a dash.
-        // Increase the morse string index by 1
-        add_character_to_string(&imuMorseMessage, '-', imuMorseMessage.currentIndex + 1);
-        printf("__Received Morse character '-' and go back to DATA_READY__\n");
-        // Set the programState to be DATA_READY to be able to send space
-        programState = DATA_READY;
+        printf("__Received Morse character '%c' with %s and go back to DATA_READY__\n", symbol, gesture->name);
     }
+    // The state machine adds the dot or dash to the message and goes to DATA_READY to be able to send space,
+    // or goes back to IDLE after a shake
+    post_event(symbol == '.' ? EVENT_DOT : (symbol == '-' ? EVENT_DASH : EVENT_SHAKE));
 }
 
-void rgb_task(void *pvParameters)
+static void playback_task(void *pvParameters)
 {
-    // Get the TaskHandle of the display controller from the parameters
-    TaskHandle_t displayControllerTask = (TaskHandle_t)pvParameters;
-    // Value to check if the task is finished for one cycle and send already notify the display controller
-    // Value of 0 -> not give notification yet, value of 1 -> already give notification
-    static int isGiveNotify = 0;
+    (void)pvParameters;
+    struct LcdItem item = {LCD_PLAYBACK_START, 0};
     while (1)
     {
-        // If the programState is in DISPLAY mode and have not sent the notification to the display controller
-        if (programState == DISPLAY && isGiveNotify == 0)
+        // Block (no CPU use) until the next received message
+        const struct MessageSlot *slot = message_ring_receive(&displayRing, DISPLAY_CONSUMER_PLAYBACK, portMAX_DELAY);
+        if (slot == NULL)
+            continue;
+        // Send the announcement that we receive a message with buzzer sound, play the message after it.
+        // A beep that ended after an earlier timeout is dropped first, the wait is bounded so a beep
+        // that is late (other tones before it) or dropped (buzzer_turn_off) does not stop the playback.
+        xSemaphoreTake(feedbackDoneSemaphore, 0);
+        if (buzzer_play_tone_async(FEEDBACK_TONE_HZ, FEEDBACK_TONE_MS, feedback_done_from_isr, NULL))
+            xSemaphoreTake(feedbackDoneSemaphore, pdMS_TO_TICKS(FEEDBACK_WAIT_MS));
+        // The lcd switches to the playback window, the letters come from the timer interruption
+        item.kind = LCD_PLAYBACK_START;
+        xQueueSend(translatedLetterQueue, &item, portMAX_DELAY);
+        // One hardware timer drives the buzzer, the rgb and the lcd, they all start on the same tick
+        if (playback_start(&slot->schedule))
         {
-            // Loops through the serial receive morse message to display it by rgb.
-            for (int i = 0; i < strlen(serialReceivedMorseMessage.message); i++)
-            {
-                printf("__Read morse character %c __\n", serialReceivedMorseMessage.message[i]);
-                if (serialReceivedMorseMessage.message[i] == '.')
-                {
-                    // If the read character is a dot -> show a blue color for 500ms
-                    rgb_led_write(0, 0, 255);
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                    // Show none-color for 300ms
-                    rgb_led_write(0, 0, 0);
-                    vTaskDelay(pdMS_TO_TICKS(300));
-                }
-                else if (serialReceivedMorseMessage.message[i] == '-')
-                {
-                    // If the read character is a dash -> show a green color for 500ms
-                    rgb_led_write(0, 255, 0);
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                    // Show none-color for 300ms
-                    rgb_led_write(0, 0, 0);
-                    vTaskDelay(pdMS_TO_TICKS(300));
-                }
-                else if (serialReceivedMorseMessage.message[i] == ' ')
-                {
-                    // If the read character is a space -> show a red color for 500ms
-                    rgb_led_write(255, 0, 0);
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                    // Show none-color for 300ms
-                    rgb_led_write(0, 0, 0);
-                    vTaskDelay(pdMS_TO_TICKS(300));
-                }
-            }
-            // After finishing, notify the display controller
-            xTaskNotifyGive(displayControllerTask);
-            // Set the isGiveNotify value to 1 so that it will not be displayed infinitely.
-            isGiveNotify = 1;
+            // Wait until the timer interruption reports the end of the message
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         }
-        else if (programState == DISPLAY_FINISHED)
+        else
         {
-            // If the programState equal DISPLAY_FINISHED -> all 3 display finished
-            // Now we can reset the isGiveNotify to be able to display another message
-            isGiveNotify = 0;
+            printf("__Playback could not start__\n");
+            item.kind = LCD_PLAYBACK_END;
+            xQueueSend(translatedLetterQueue, &item, portMAX_DELAY);
         }
+        // Give the slot back for the next message
+        message_ring_release(&displayRing, slot);
     }
 }
 
-void buzzer_task(void *pvParameters)
+static void playback_letter_from_isr(char letter)
 {
-    // Get the TaskHandle of the display controller from the parameters
-    TaskHandle_t displayControllerTask = (TaskHandle_t)pvParameters;
-    // Value to check if the task is finished for one cycle and send already notify the display controller
-    // Value of 0 -> not give notification yet, value of 1 -> already give notification
-    static int isGiveNotify = 0;
-    while (1)
-    {
-        // If the programState is in DISPLAY mode and have not sent the notification to the display controller
-        if (programState == DISPLAY && isGiveNotify == 0)
-        {
-            // Loops through the serial receive morse message to display it by buzzer.
-            for (int i = 0; i < strlen(serialReceivedMorseMessage.message); i++)
-            {
-                if (serialReceivedMorseMessage.message[i] == '.')
-                {
-                    // If read character is a dot -> play with tone 440 for 500ms
-                    buzzer_play_tone(440, 500);
-                    // interrupt the flow for 300ms
-                    vTaskDelay(pdMS_TO_TICKS(300));
-                }
-                else if (serialReceivedMorseMessage.message[i] == '-')
-                {
-                    // If read character is a dash -> play with tone 440 for 1000ms
-                    buzzer_play_tone(440, 1000);
-                    // interrupt the flow for 300ms
-                    vTaskDelay(pdMS_TO_TICKS(300));
-                }
-                else if (serialReceivedMorseMessage.message[i] == ' ')
-                {
-                    // If read character is a space -> interrupt the flow for 300ms
-                    vTaskDelay(pdMS_TO_TICKS(300));
-                }
-            }
-            // After finishing, notify the display controller
-            xTaskNotifyGive(displayControllerTask);
-            // Set the isGiveNotify value to 1 so that it will not be displayed infinitely.
-            isGiveNotify = 1;
-        }
-        else if (programState == DISPLAY_FINISHED)
-        {
-            // If the programState equal DISPLAY_FINISHED -> all 3 display finished
-            // Now we can reset the isGiveNotify to be able to display another message
-            isGiveNotify = 0;
-        }
-        vTaskDelay(100);
-    }
+    // The queue is not full in practice, if it is the letter is only missing on the lcd
+    struct LcdItem item = {LCD_PLAYBACK_LETTER, letter};
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xQueueSendFromISR(translatedLetterQueue, &item, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+static void feedback_done_from_isr(void *userData)
+{
+    (void)userData;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR(feedbackDoneSemaphore, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
-void translate_receives_morse_codes()
+
+static void playback_finished_from_isr(void)
 {
-    // Define a struct type of morse alphabet character to store the recognized character from morse message.
-    struct MorseAlphabet singleMorseCode = {0};
-    for (int i = 0; i < INPUT_BUFFER_SIZE; i++)
+    struct LcdItem item = {LCD_PLAYBACK_END, 0};
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    xQueueSendFromISR(translatedLetterQueue, &item, &higherPriorityTaskWoken);
+    vTaskNotifyGiveFromISR(playbackTaskHandle, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+static void stream_serial_morse_character(char character)
+{
+    // Decode the character right away instead of waiting for the whole message
+    char decoded[MORSE_DECODER_MAX_OUTPUT];
+    int decodedCount = morse_decoder_push(&serialMorseDecoder, character, decoded);
+    for (int i = 0; i < decodedCount; i++)
     {
-        // If the read character is not a space
-        if (serialReceivedMorseMessage.message[i] != ' ')
-        {
-            // Store the read character (dot/dash) to the morse alphabet character to be waited to be translated.
-            singleMorseCode.morseCode[singleMorseCode.currMorseCodeIndex] = serialReceivedMorseMessage.message[i];
-            // Increase the current index by 1
-            singleMorseCode.currMorseCodeIndex += 1;
-        }
-        else
-        {
-            // If it is a space, check if the previous position is a space or not
-            if (serialReceivedMorseMessage.message[i - 1] == ' ')
-            {
-                // If there exists a space before it, we need to check if the next position is a '\0' or '\n' to stop the program.
-                if (serialReceivedMorseMessage.message[i + 1] == '\0' || serialReceivedMorseMessage.message[i + 1] == '\n')
-                {
-                    add_character_to_string(&translatedMessage, '\n', translatedMessage.currentIndex + 1);
-                    add_character_to_string(&translatedMessage, '\0', 0);
-                    break;
-                }
-                else
-                {
-                    // If the next character is not '\0' or '\n' -> we put a space in the translated string to seperate 2 sentences.
-                    add_character_to_string(&translatedMessage, ' ', translatedMessage.currentIndex + 1);
-                }
-            }
-            else
-            {
-                // If it is the first time reading the space -> we have to search the current read morse code for a normal letter.
-                // Terminate the read morse string
-                singleMorseCode.morseCode[singleMorseCode.currMorseCodeIndex] = '\0';
-                // Reset the current morse index.
-                singleMorseCode.currMorseCodeIndex = 0;
-                // Find the correct letter base on the read morse string above.
-                char translatedLetter = find_letter_from_morse_code(singleMorseCode.morseCode);
-                // Add it to the translated string and increase the index by 1
-                add_character_to_string(&translatedMessage, translatedLetter, translatedMessage.currentIndex + 1);
-            }
-        }
+        // Block if the lcd is behind, the rest of the message stays in the usb buffer meanwhile
+        struct LcdItem item = {decoded[i] == '\n' ? LCD_PREVIEW_END : LCD_PREVIEW_LETTER, decoded[i]};
+        xQueueSend(translatedLetterQueue, &item, portMAX_DELAY);
     }
-    printf("__Translated string %s__\n", translatedMessage.message);
 }
 
-char find_letter_from_morse_code(char *morseCode)
+static void stream_text_character(char character)
 {
-    // Loops through the alphabet to check for the matched letter of the morse code.
-    for (int i = 0; i < MORSE_ALPHABET_SIZE; i++)
+    // Text does not need decoding, show the (lower case) character as it is
+    if (character >= 'A' && character <= 'Z')
+        character = (char)(character - 'A' + 'a');
+    struct LcdItem item = {LCD_PREVIEW_LETTER, character};
+    xQueueSend(translatedLetterQueue, &item, portMAX_DELAY);
+}
+
+static void finish_received_message(struct MessageSlot *slot, bool textMessage)
+{
+    // A text message was encoded while it arrived, a morse message gets its schedule now
+    if (!textMessage && !morse_schedule_from_packed(&slot->schedule, &serialReceivedMorseMessage, MORSE_PLAYBACK_WPM))
     {
-        if (strcmp(morseCode, morseCodes[i].morseCode) == 0)
-        {
-            return morseCodes[i].letter;
-        }
+        printf("__Morse message is too long for the schedule__\n");
     }
-    // If find nothing, return 'n'
-    return 'n';
+    printf("__Schedule with %u events, %lu ms at %u ms per unit__\n", slot->schedule.count,
+           (unsigned long)slot->schedule.totalMs, slot->schedule.unitMs);
+    // Give the message to the display tasks, the buzzer and the rgb start playing when they are free
+    message_ring_publish(&displayRing, slot);
+    // Finish the decoded text, the lcd shows the playback when the timeline starts it
+    stream_serial_morse_character('\n');
 }
 
 static void buzzer_music_play()
 {
     // Function to play music
-    // Array to store different tone of the song.
-    int melody[SONG_TONE_SIZE] = {
-        330, 330, 330, 330, 330, 330, 330, 392, 262, 294, 330, 349, 349, 349, 330, 330,
-        330, 330, 330, 330, 330, 392, 262, 294, 330};
-    // Array to store the duration of each tone above
-    int durations[SONG_TONE_SIZE] = {
-        250, 250, 500, 250, 250, 500, 250, 250, 250, 250, 500, 250, 250, 500, 250, 250,
-        250, 250, 500, 250, 250, 500, 250, 250, 500};
-
-    // Loops through 2 array above and play the song
-    for (int i = 0; i < SONG_TONE_SIZE; i++)
+    // Tone (Hz) and duration (ms) of each note of the song, with a 50ms rest between the notes.
+    static const buzzer_note_t song[2 * SONG_TONE_SIZE] = {
+        {330, 250}, {0, 50}, {330, 250}, {0, 50}, {330, 500}, {0, 50}, {330, 250}, {0, 50}, {330, 250}, {0, 50},
+        {330, 500}, {0, 50}, {330, 250}, {0, 50}, {392, 250}, {0, 50}, {262, 250}, {0, 50}, {294, 250}, {0, 50},
+        {330, 500}, {0, 50}, {349, 250}, {0, 50}, {349, 250}, {0, 50}, {349, 500}, {0, 50}, {330, 250}, {0, 50},
+        {330, 250}, {0, 50}, {330, 250}, {0, 50}, {330, 250}, {0, 50}, {330, 500}, {0, 50}, {330, 250}, {0, 50},
+        {330, 250}, {0, 50}, {392, 500}, {0, 50}, {262, 250}, {0, 50}, {294, 250}, {0, 50}, {330, 500}, {0, 50}};
+
+    // Queue the whole song, the PWM and a timer play it while the tasks go on
+    if (!buzzer_play_sequence_async(song, 2 * SONG_TONE_SIZE, NULL, NULL))
     {
-        // Play the note with the correct melody and duration
-        buzzer_play_tone(melody[i], durations[i]);
-        // Sleep 50ms for interruption between each note.
-        sleep_ms(50);
+        printf("__Buzzer is busy, cannot play the music__\n");
     }
 }
 
@@ -672,151 +737,310 @@ static void serial_receive_task(void *arg)
 {
     // Function to receive the string from the serial client
     (void)arg;
+    // The previous message is finished, the next received character starts a new one
+    bool startNewMessage = true;
+    // The message is plain text to encode instead of morse code
+    bool textMessage = false;
+    // Ring slot the current message is written to (owned by this task until it is published)
+    struct MessageSlot *slot = NULL;
+    // Bytes taken from the usb buffer in one read
+    char rxBuffer[SERIAL_RX_CHUNK_SIZE];
+    // The usb callback (and the tcp receive callback) wake this task, it never polls
+    serial_rx_init(xTaskGetCurrentTaskHandle());
 
     while (true)
     {
-        // take one char per time and store it in line array, until reeceived the \n
-        int receivedChar = getchar_timeout_us(0);
-        if (receivedChar != PICO_ERROR_TIMEOUT)
+        // Take all the received bytes at once (a pasted message is read in chunks without any delay)
+        int receivedCount = serial_rx_read(rxBuffer, sizeof(rxBuffer), portMAX_DELAY);
+        for (int i = 0; i < receivedCount; i++)
         {
-            // If the programState is not in the DISPLAY mode then we can update the message
-            if (programState != DISPLAY)
+            char receivedChar = rxBuffer[i];
+            // If it is character '\r' -> ignore.
+            if (receivedChar == '\r')
+                continue;
+            if (startNewMessage)
             {
-                // If it is character '\r' -> ignore.
-                if (receivedChar == '\r')
-                    continue;
-                if (serialReceivedMorseMessage.currentIndex >= INPUT_BUFFER_SIZE)
-                {
-                    // If it reach the overflow -> update the last index to be '\0' and reset the currentindex
-                    serialReceivedMorseMessage.currentIndex -= 1;
-                    add_character_to_string(&serialReceivedMorseMessage, '\0', 0);
-                    printf("__Overflow text warning__\n");
-                    // Set the programState to display the string
-                    programState = DISPLAY;
-                }
-                else if (receivedChar == '\n')
+                // Take a free slot, only wait when all slots are still being displayed (the rest stays in the usb buffer)
+                slot = message_ring_acquire(&displayRing, 0);
+                if (slot == NULL)
                 {
-                    // If the read character is '\n' -> we need to terminate the string and display it
-                    // Send the announcement that we receive string with buzzer sound
-                    sending_feedback();
-                    sleep_ms(500);
-                    add_character_to_string(&serialReceivedMorseMessage, '\0', 0);
-                    programState = DISPLAY;
-                    printf("__Received String %s__\n", serialReceivedMorseMessage.message);
-                }
-                else
-                {
-                    // If it is normal morse character -> add it to the current position and update the current position by 1
-                    add_character_to_string(&serialReceivedMorseMessage, receivedChar, serialReceivedMorseMessage.currentIndex + 1);
-                    printf("__Received letter=%c__\n", receivedChar);
+                    printf("__All display slots busy, waiting__\n");
+                    slot = message_ring_acquire(&displayRing, portMAX_DELAY);
                 }
+                morse_packed_clear(&serialReceivedMorseMessage);
+                morse_schedule_reset(&slot->schedule, MORSE_PLAYBACK_WPM);
+                // A message starting with a morse character is morse code, anything else is text
+                textMessage = !(receivedChar == '.' || receivedChar == '-' || receivedChar == ' ' || receivedChar == '\n');
+                startNewMessage = false;
+            }
+            if (textMessage ? morse_schedule_is_full(&slot->schedule) : serialReceivedMorseMessage.count >= MORSE_PACKED_CAPACITY)
+            {
+                // If it reach the overflow -> display what we have
+                startNewMessage = true;
+                printf("__Overflow text warning__\n");
+                finish_received_message(slot, textMessage);
+            }
+            else if (receivedChar == '\n')
+            {
+                // If the read character is '\n' -> we need to terminate the string and display it
+                // (the playback task announces it with the buzzer, the receiving goes on)
+                startNewMessage = true;
+                printf("__Received String with %u morse characters__\n", serialReceivedMorseMessage.count);
+                finish_received_message(slot, textMessage);
+            }
+            else if (textMessage)
+            {
+                // If it is a text character -> encode it right away (characters without a morse code are ignored)
+                if (morse_schedule_append_char(&slot->schedule, receivedChar))
+                    stream_text_character(receivedChar);
             }
             else
             {
-                printf("__Currently in display mode, cannot receive more data__\n");
+                // If it is normal morse character -> pack it into the message (other characters are ignored)
+                add_character_to_message(&serialReceivedMorseMessage, receivedChar);
+                stream_serial_morse_character(receivedChar);
             }
         }
 
-        else
+        if (tcpReceivedTextReady && startNewMessage)
         {
-            vTaskDelay(pdMS_TO_TICKS(100));
+            // A text line from the tcp server is played the same way as a serial text message
+            slot = message_ring_acquire(&displayRing, portMAX_DELAY);
+            morse_schedule_reset(&slot->schedule, MORSE_PLAYBACK_WPM);
+            for (int i = 0; i < tcpReceivedTextLength; i++)
+            {
+                if (morse_schedule_append_char(&slot->schedule, tcpReceivedText[i]))
+                    stream_text_character(tcpReceivedText[i]);
+            }
+            tcpReceivedTextReady = false;
+            finish_received_message(slot, true);
         }
     }
 }
 
 static void lcd_display_task(void *pvParameters)
 {
-    // Get the TaskHandle of the display controller from the parameters
-    TaskHandle_t displayControllerTask = (TaskHandle_t)pvParameters;
-    // Value to check if the task is finished for one cycle and send already notify the display controller
-    // Value of 0 -> not give notification yet, value of 1 -> already give notification
-    static int isGiveNotify = 0;
-    write_text("Waiting...");
+    (void)pvParameters;
+    // Text lines of the lcd: one for the message being received and one for the message being played.
+    static struct LcdTicker preview;
+    static struct LcdTicker playback;
+    lcd_ticker_clear(&preview);
+    lcd_ticker_clear(&playback);
+    // While a message plays, the received letters are only collected in the preview line
+    bool playing = false;
+    // Next scroll step while the shown line has not reached its end
+    bool scrolling = false;
+    TickType_t nextStep = 0;
+    struct LcdItem item;
+    lcd_ticker_show(&preview, "Waiting...");
     while (true)
     {
-        // If the programState is in DISPLAY mode and have not sent the notification to the display controller
-        if (programState == DISPLAY && isGiveNotify == 0)
+        // Wait (not CPU blocking) until the serial task or the playback timer sends the next item,
+        // or until the next scroll step
+        TickType_t wait = portMAX_DELAY;
+        if (scrolling)
         {
-            // Translate the serial morse code.
-            translate_receives_morse_codes();
-            // Get the length of the translated message
-            int length = strlen(translatedMessage.message);
-            // Initialize the display string with length 10
-            char displayString[WINDOW_SIZE + 1];
-            // Clear the display
-            clear_display();
-            // Create the sliding window with the size of 9 -> showing 9 character each loop.
-            if (length <= WINDOW_SIZE)
-            {
-                printf("__translated message: %s__\n", translatedMessage.message);
-                write_text(translatedMessage.message);
-                vTaskDelay(pdMS_TO_TICKS(500));
-                clear_display();
-            }
-            else
-            {
-                for (int i = 0; i <= length - WINDOW_SIZE; i++)
-                {
-                    // Copy the from the current i to character at position i + WINDOWSIZE - 1 to the display string
-                    memcpy(displayString, &translatedMessage.message[i], WINDOW_SIZE);
-                    // Set the position at WINDOW_SIZE = '\0' to terminate the string.
-                    displayString[WINDOW_SIZE] = '\0';
-                    printf("__Display string %s__\n", displayString);
-                    // Write the display string to the lcd for 500ms
-                    write_text(displayString);
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                    // Clear the display after that.
-                    clear_display();
-                }
-            }
-
-            // After finishing showing sliding text -> write back to Waiting... string
-            write_text("Waiting...");
-            // Notify the display controller task that lcd task is finish
-            xTaskNotifyGive(displayControllerTask);
-            // Set is notify to equal 1 -> not in an infinite cycle of showing it on the lcd
-            isGiveNotify = 1;
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(nextStep - now) > 0 ? nextStep - now : 0;
+        }
+        if (xQueueReceive(translatedLetterQueue, &item, wait) != pdTRUE)
+        {
+            // Scroll the shown line by a few pixels, only its 2 pages are sent to the display
+            scrolling = playing ? lcd_ticker_step(&playback, "") : lcd_ticker_step(&preview, "Waiting...");
+            nextStep += pdMS_TO_TICKS(LCD_TICKER_STEP_MS);
+            continue;
+        }
+        struct LcdTicker *changed = NULL;
+        switch (item.kind)
+        {
+        case LCD_PREVIEW_LETTER:
+            // The letter scrolls in as soon as it is decoded
+            lcd_ticker_push(&preview, item.letter);
+            changed = &preview;
+            break;
+        case LCD_PREVIEW_END:
+            // The message waits for the playback, the next letter starts a new line. The display keeps the
+            // last one until then.
+            lcd_ticker_clear(&preview);
+            if (!playing)
+                scrolling = false;
+            break;
+        case LCD_PLAYBACK_START:
+            playing = true;
+            lcd_ticker_clear(&playback);
+            lcd_ticker_show(&playback, "");
+            break;
+        case LCD_PLAYBACK_LETTER:
+            // Starts to scroll in on the same timer tick the buzzer and the rgb start the letter
+            lcd_ticker_push(&playback, item.letter);
+            changed = &playback;
+            break;
+        case LCD_PLAYBACK_END:
+            // Go back to the message being received, or write back to Waiting... string
+            playing = false;
+            scrolling = lcd_ticker_step(&preview, "Waiting...");
+            nextStep = xTaskGetTickCount() + pdMS_TO_TICKS(LCD_TICKER_STEP_MS);
+            break;
+        default:
+            break;
         }
-        else if (programState == DISPLAY_FINISHED)
+        // A new letter on the shown line: start scrolling it in
+        if (changed != NULL && changed == (playing ? &playback : &preview) && !scrolling)
         {
-            // If the programState equal DISPLAY_FINISHED -> all 3 display finished
-            // Now we can reset the isGiveNotify to be able to display another message
-            isGiveNotify = 0;
+            printf("__Display string %s__\n", changed->text);
+            scrolling = lcd_ticker_step(changed, "");
+            nextStep = xTaskGetTickCount() + pdMS_TO_TICKS(LCD_TICKER_STEP_MS);
         }
-        vTaskDelay(pdMS_TO_TICKS(200));
     }
 }
 
-static void display_controller_task(void *args)
+// Offset where the end of the text is on the display, or the start of a short text at the margin
+static int32_t lcd_ticker_target(const struct LcdTicker *ticker)
 {
-    // Count the finished display task (lcd, buzzer, rgb)
-    int finishedDisplayTask = 0;
+    int32_t target = (int32_t)text_width(ticker->text) + LCD_TICKER_MARGIN - LCD_WIDTH;
+    return target > -LCD_TICKER_MARGIN ? target : -LCD_TICKER_MARGIN;
+}
+
+static void lcd_ticker_push(struct LcdTicker *ticker, char letter)
+{
+    if (ticker->length == LCD_TICKER_LETTERS)
+    {
+        // Line is full -> drop the first letter, long scrolled out, and keep the others where they are
+        ticker->offset -= (int32_t)text_width(" ");
+        memmove(ticker->text, &ticker->text[1], LCD_TICKER_LETTERS - 1);
+        ticker->length--;
+    }
+    ticker->text[ticker->length++] = letter;
+    ticker->text[ticker->length] = '\0';
+}
+
+static void lcd_ticker_clear(struct LcdTicker *ticker)
+{
+    ticker->length = 0;
+    ticker->text[0] = '\0';
+    ticker->offset = -LCD_TICKER_MARGIN;
+}
+
+static bool lcd_ticker_step(struct LcdTicker *ticker, const char *placeholder)
+{
+    int32_t target = lcd_ticker_target(ticker);
+    if (ticker->offset < target)
+    {
+        ticker->offset += LCD_TICKER_STEP_PX;
+        if (ticker->offset > target)
+            ticker->offset = target;
+    }
+    else
+    {
+        // A short text does not scroll
+        ticker->offset = target;
+    }
+    lcd_ticker_show(ticker, placeholder);
+    return ticker->offset < target;
+}
+
+static void lcd_ticker_show(const struct LcdTicker *ticker, const char *placeholder)
+{
+    if (ticker->length == 0)
+        write_text_scroll(placeholder, -LCD_TICKER_MARGIN);
+    else
+        write_text_scroll(ticker->text, ticker->offset);
+}
+
+static void set_state(enum state newState)
+{
+    programState = newState;
+    // Wake the tasks that work in the new state
+    EventBits_t bits = 0;
+    if (newState == WAITING_DATA)
+        bits = APP_BIT_IMU_ENABLED;
+    else if (newState == DATA_READY || newState == SPACES_REQUIREMENTS_SATISFIED)
+        bits = APP_BIT_SPACE_ENABLED;
+    else if (newState == SEND_DATA)
+        bits = APP_BIT_SEND_REQUEST;
+    xEventGroupClearBits(appEventGroup, APP_STATE_BITS & ~bits);
+    xEventGroupSetBits(appEventGroup, bits);
+}
+
+static void post_event(enum event appEvent)
+{
+    uint8_t item = (uint8_t)appEvent;
+    xQueueSend(appEventQueue, &item, portMAX_DELAY);
+}
+
+static void state_machine_task(void *args)
+{
+    (void)args;
+    uint8_t appEvent;
     while (true)
     {
-        // If counter < 3 -> waiting for notification from the 3 display method
-        if (finishedDisplayTask < 3)
-        {
-            // NOte that this function is not CPU blocking, it only run when receive notification
-            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-            // If receive notification -> increase the counter by 1
-            finishedDisplayTask++;
-        }
-        else
+        // NOte that this function is not CPU blocking, it only run when an event is received
+        if (xQueueReceive(appEventQueue, &appEvent, portMAX_DELAY) != pdTRUE)
+            continue;
+        switch (appEvent)
         {
-            // If counter is >= 3 -> Enough notification from 3 display
-            // Reset the counter for another display cycle
-            finishedDisplayTask = 0;
-            // Set the programState to be DISPLAY_FINISHED so that 3 display task can reset their isGiveNotify
-            programState = DISPLAY_FINISHED;
-            printf("__3 task display finished__\n");
+        case EVENT_BUTTON1:
+            // Button1 -> start to read the IMU sensor data (not while sending, displaying runs on its own)
+            if (programState != SEND_DATA)
+            {
+                printf("__Start to read sensor data__\n");
+                set_state(WAITING_DATA);
+            }
+            else
+            {
+                printf("__ Already sending, please wait until finished__\n");
+            }
+            break;
+        case EVENT_SPACE:
+            if (programState == SPACES_REQUIREMENTS_SATISFIED)
+            {
+                // If there are 2 consecutive spaces -> the message is complete, send it to serial monitor and tcp server
+                set_state(SEND_DATA);
+            }
+            else if (programState == DATA_READY)
+            {
+                printf("__Send space__\n");
+                // Check if there is already 1 space before this one.
+                bool secondSpace = message_ends_with_space(&imuMorseMessage);
+                add_character_to_message(&imuMorseMessage, ' ');
+                if (secondSpace)
+                {
+                    // If it is, then the next space sends the message.
+                    printf("__2 space consecutively detected__\n");
+                    set_state(SPACES_REQUIREMENTS_SATISFIED);
+                }
+            }
+            else
+            {
+                printf("__Unavailble to send the space here__\n");
+            }
+            break;
+        case EVENT_DOT:
+        case EVENT_DASH:
+            // A morse character from the IMU -> add it to the message and wait for a space or the next character
+            if (programState == WAITING_DATA || programState == DATA_READY)
+            {
+                add_character_to_message(&imuMorseMessage, appEvent == EVENT_DOT ? '.' : '-');
+                set_state(DATA_READY);
+            }
+            break;
+        case EVENT_SHAKE:
+            if (programState == WAITING_DATA)
+                set_state(IDLE);
+            break;
+        case EVENT_SEND_DONE:
+            set_state(IDLE);
+            break;
+        default:
+            break;
         }
     }
 }
 
 void sending_feedback()
 {
-    // Function to play a buzzer to announce.
-    buzzer_play_tone(640, 500);
+    // Function to play a buzzer to announce (returns right away, the beep plays in the background).
+    buzzer_play_tone_async(FEEDBACK_TONE_HZ, FEEDBACK_TONE_MS, NULL, NULL);
 }
 
 void wirelessTask()
@@ -948,13 +1172,6 @@ err_t tcp_client_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err
     {
         return tcp_result(arg, -1);
     }
-    if (programState == DISPLAY)
-    {
-        // If currently in display mode -> ignore the received data
-        printf("__Currently in display mode, ignore received data__\n");
-        pbuf_free(p);
-        return ERR_OK;
-    }
     // this method is callback from lwIP, so cyw43_arch_lwip_begin is not required, however you
     // can use this method to cause an assertion in debug mode, if this method is called when
     // cyw43_arch_lwip_begin IS needed
@@ -974,6 +1191,21 @@ err_t tcp_client_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err
     }
     pbuf_free(p);
 
+    // A complete text line is handed to the serial receive task to be encoded and played
+    uint8_t *lineEnd = memchr(clientState->buffer, '\n', clientState->buffer_len);
+    if (lineEnd != NULL && !tcpReceivedTextReady)
+    {
+        int lineLength = (int)(lineEnd - clientState->buffer);
+        memcpy(tcpReceivedText, clientState->buffer, lineLength);
+        tcpReceivedTextLength = lineLength;
+        tcpReceivedTextReady = true;
+        // Wake the serial receive task, it encodes the line
+        serial_rx_wake();
+        // Keep the bytes after the line for the next one
+        clientState->buffer_len -= lineLength + 1;
+        memmove(clientState->buffer, lineEnd + 1, clientState->buffer_len);
+    }
+
     if (clientState->buffer_len == BUF_SIZE)
     {
         // Send the announcement that we receive string with buzzer sound
@@ -1056,7 +1288,17 @@ void send_data_tcp()
         return;
     // If clientState is not null and the connected boolean is true -> send the data over the tcp_server
     printf("__Send data over TCP__\n");
-    tcp_write(clientState->tcp_pcb, imuMorseMessage.message, strlen(imuMorseMessage.message), TCP_WRITE_FLAG_COPY);
+#if TCP_SEND_PACKED_MORSE
+    // Symbol count + 2 bits per symbol, a quarter of the text size
+    uint8_t payload[MORSE_PACKED_SERIALIZED_MAX];
+    size_t payloadLength = morse_packed_serialize(&imuMorseMessage, payload, sizeof(payload));
+#else
+    // Morse text terminated with '\n'
+    char payload[MORSE_PACKED_TEXT_MAX + 1];
+    size_t payloadLength = morse_packed_to_text(&imuMorseMessage, payload, sizeof(payload) - 1);
+    payload[payloadLength++] = '\n';
+#endif
+    tcp_write(clientState->tcp_pcb, payload, payloadLength, TCP_WRITE_FLAG_COPY);
 }
 void light_sensor_task(void *pvParameters)
 {
@@ -1065,43 +1307,26 @@ void light_sensor_task(void *pvParameters)
     uint32_t ambientLight;
     while (1)
     {
-        // Only read the data from the ambientlight when programState is DATA_READY or SPACES_REQUIREMENTS_SATISFIED
-        if (programState == DATA_READY || programState == SPACES_REQUIREMENTS_SATISFIED)
+        // Only read the data from the ambientlight in DATA_READY or SPACES_REQUIREMENTS_SATISFIED, block otherwise
+        xEventGroupWaitBits(appEventGroup, APP_BIT_SPACE_ENABLED, pdFALSE, pdTRUE, portMAX_DELAY);
+        // Read the ambientlight
+        ambientLight = veml6030_read_light();
+#if SAMPLE_OUTPUT == SAMPLE_OUTPUT_TELEMETRY
+        uint8_t payload[TELEMETRY_LIGHT_SIZE];
+        telemetry_put_u32(telemetry_put_u32(payload, to_ms_since_boot(get_absolute_time())), ambientLight);
+        telemetry_send(TELEMETRY_LIGHT, payload, sizeof(payload));
+#elif SAMPLE_OUTPUT == SAMPLE_OUTPUT_LOG
+        printf("light sensor %u\n", ambientLight);
+#endif
+        // Check is it below the ambient threshold
+        if (ambientLight < LIGHT_THRESHOLD)
         {
-            // Read the ambientlight
-            ambientLight = veml6030_read_light();
-            printf("light sensor %u\n", ambientLight);
-            // Check is it below the ambient threshold
-            if (ambientLight < LIGHT_THRESHOLD)
-            {
-                // If it is, then check if it is in the 2 space consecutive mode or not
-                if (programState == SPACES_REQUIREMENTS_SATISFIED)
-                {
-                    // If it is then terminate the string and update the current index.
-                    add_character_to_string(&imuMorseMessage, '\n', imuMorseMessage.currentIndex + 1);
-                    add_character_to_string(&imuMorseMessage, '\0', 0);
-                    // Set the programState to be in mode of send data
-                    programState = SEND_DATA;
-                }
-
-                else
-                {
-                    // If it is not 2 space consecutively already
-                    printf("Light Button: Send space\n");
-                    // Check if the previous position is the space
-                    if (imuMorseMessage.message[imuMorseMessage.currentIndex - 1] == ' ')
-                    {
-                        // If it is then we will update the programState
-                        printf("Light Button: 2 spaces consecutively\n");
-                        programState = SPACES_REQUIREMENTS_SATISFIED;
-                    }
-                    // Add the space to the message string and update the current index
-                    add_character_to_string(&imuMorseMessage, ' ', imuMorseMessage.currentIndex + 1);
-                    // Delay for 2000ms to interrupt the light sensor (if not, it will update space really fast because sensor read really fast)
-                    vTaskDelay(pdMS_TO_TICKS(2000));
-                }
-            }
+            // If it is, the state machine adds a space (or sends the message after 2 spaces)
+            printf("Light Button: Send space\n");
+            post_event(EVENT_SPACE);
+            // Delay for 2000ms to interrupt the light sensor (if not, it will update space really fast because sensor read really fast)
+            vTaskDelay(pdMS_TO_TICKS(2000));
         }
         vTaskDelay(pdMS_TO_TICKS(100));
     }
-}
\ No newline at end of file
+}
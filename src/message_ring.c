@@ -0,0 +1,64 @@
+#include "message_ring.h"
+
+bool message_ring_init(struct MessageRing *ring, uint8_t consumerCount)
+{
+    if (consumerCount == 0 || consumerCount > MESSAGE_RING_MAX_CONSUMERS)
+        return false;
+    ring->published = 0;
+    ring->consumerCount = consumerCount;
+    for (int i = 0; i < MESSAGE_RING_SLOTS; i++)
+    {
+        ring->slots[i].refCount = 0;
+    }
+    ring->freeSlots = xSemaphoreCreateCounting(MESSAGE_RING_SLOTS, MESSAGE_RING_SLOTS);
+    if (ring->freeSlots == NULL)
+        return false;
+    for (uint8_t i = 0; i < consumerCount; i++)
+    {
+        // A consumer can never be more than MESSAGE_RING_SLOTS messages behind
+        ring->consumerQueues[i] = xQueueCreate(MESSAGE_RING_SLOTS, sizeof(struct MessageSlot *));
+        if (ring->consumerQueues[i] == NULL)
+            return false;
+    }
+    return true;
+}
+
+struct MessageSlot *message_ring_acquire(struct MessageRing *ring, TickType_t timeout)
+{
+    if (xSemaphoreTake(ring->freeSlots, timeout) != pdTRUE)
+        return NULL;
+    // Consumers release in publish order, so the slot after the last published one is the free one
+    return &ring->slots[ring->published % MESSAGE_RING_SLOTS];
+}
+
+void message_ring_publish(struct MessageRing *ring, struct MessageSlot *slot)
+{
+    slot->sequence = ++ring->published;
+    // Set the count before any consumer can see the slot
+    slot->refCount = ring->consumerCount;
+    for (uint8_t i = 0; i < ring->consumerCount; i++)
+    {
+        // Never blocks: the queue has room for every slot
+        xQueueSend(ring->consumerQueues[i], &slot, portMAX_DELAY);
+    }
+}
+
+const struct MessageSlot *message_ring_receive(struct MessageRing *ring, uint8_t consumer, TickType_t timeout)
+{
+    struct MessageSlot *slot = NULL;
+    if (consumer >= ring->consumerCount || xQueueReceive(ring->consumerQueues[consumer], &slot, timeout) != pdTRUE)
+        return NULL;
+    return slot;
+}
+
+void message_ring_release(struct MessageRing *ring, const struct MessageSlot *slot)
+{
+    struct MessageSlot *owned = &ring->slots[slot - ring->slots];
+    uint8_t left;
+    // The Cortex-M0+ has no atomic decrement, a short critical section does the same
+    taskENTER_CRITICAL();
+    left = --owned->refCount;
+    taskEXIT_CRITICAL();
+    if (left == 0)
+        xSemaphoreGive(ring->freeSlots);
+}
@@ -0,0 +1,51 @@
+#ifndef MESSAGE_RING_H
+#define MESSAGE_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <semphr.h>
+
+#include "morse.h"
+
+// Messages that can be waiting or playing at the same time
+#define MESSAGE_RING_SLOTS 3
+// Most tasks that can read every message (the firmware has one: the playback task, see DISPLAY_CONSUMER_COUNT)
+#define MESSAGE_RING_MAX_CONSUMERS 3
+
+// One received message. The producer fills it, after publishing it is read-only until every consumer released it.
+struct MessageSlot
+{
+    struct MorseSchedule schedule;
+    uint32_t sequence;         // Number of the message, counts up from 1
+    volatile uint8_t refCount; // Consumers that did not release the slot yet (0 = free)
+};
+
+// Single producer / multi consumer ring of message slots. Every consumer gets every published slot in order.
+struct MessageRing
+{
+    struct MessageSlot slots[MESSAGE_RING_SLOTS];
+    uint32_t published;                                      // Number of published messages
+    uint8_t consumerCount;                                   // Consumers registered at init
+    SemaphoreHandle_t freeSlots;                             // Counts the slots the producer can take
+    QueueHandle_t consumerQueues[MESSAGE_RING_MAX_CONSUMERS]; // Published slots per consumer
+};
+
+// Create the semaphore and the consumer queues. Returns false if they cannot be allocated.
+bool message_ring_init(struct MessageRing *ring, uint8_t consumerCount);
+
+// Producer: take the next free slot to write into, waiting up to timeout. Returns NULL on timeout.
+struct MessageSlot *message_ring_acquire(struct MessageRing *ring, TickType_t timeout);
+
+// Producer: hand the written slot to every consumer (no copy, they all read the same slot).
+void message_ring_publish(struct MessageRing *ring, struct MessageSlot *slot);
+
+// Consumer: wait for the next published slot. Returns NULL on timeout.
+const struct MessageSlot *message_ring_receive(struct MessageRing *ring, uint8_t consumer, TickType_t timeout);
+
+// Consumer: done with the slot, the last consumer gives it back to the producer.
+void message_ring_release(struct MessageRing *ring, const struct MessageSlot *slot);
+
+#endif
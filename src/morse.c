@@ -0,0 +1,425 @@
+#include <string.h>
+
+#include "morse.h"
+
+// ITU-R M.1677-1 table plus the common non-ITU extras ('!', '&', ';', '_', '"').
+// Built at compile time: every entry sits at the trie node reached by its code.
+const char morseTrie[MORSE_TRIE_SIZE] = {
+    [  2] = 'e', // .
+    [  3] = 't', // -
+    [  4] = 'i', // ..
+    [  5] = 'a', // .-
+    [  6] = 'n', // -.
+    [  7] = 'm', // --
+    [  8] = 's', // ...
+    [  9] = 'u', // ..-
+    [ 10] = 'r', // .-.
+    [ 11] = 'w', // .--
+    [ 12] = 'd', // -..
+    [ 13] = 'k', // -.-
+    [ 14] = 'g', // --.
+    [ 15] = 'o', // ---
+    [ 16] = 'h', // ....
+    [ 17] = 'v', // ...-
+    [ 18] = 'f', // ..-.
+    [ 20] = 'l', // .-..
+    [ 22] = 'p', // .--.
+    [ 23] = 'j', // .---
+    [ 24] = 'b', // -...
+    [ 25] = 'x', // -..-
+    [ 26] = 'c', // -.-.
+    [ 27] = 'y', // -.--
+    [ 28] = 'z', // --..
+    [ 29] = 'q', // --.-
+    [ 32] = '5', // .....
+    [ 33] = '4', // ....-
+    [ 34] = MORSE_PROSIGN_UNDERSTOOD, // ...-.
+    [ 35] = '3', // ...--
+    [ 39] = '2', // ..---
+    [ 40] = '&', // .-...
+    [ 42] = '+', // .-.-.
+    [ 47] = '1', // .----
+    [ 48] = '6', // -....
+    [ 49] = '=', // -...-
+    [ 50] = '/', // -..-.
+    [ 53] = MORSE_PROSIGN_STARTING_SIGNAL, // -.-.-
+    [ 54] = '(', // -.--.
+    [ 56] = '7', // --...
+    [ 60] = '8', // ---..
+    [ 62] = '9', // ----.
+    [ 63] = '0', // -----
+    [ 69] = MORSE_PROSIGN_END_OF_WORK, // ...-.-
+    [ 76] = '?', // ..--..
+    [ 77] = '_', // ..--.-
+    [ 82] = '"', // .-..-.
+    [ 85] = '.', // .-.-.-
+    [ 90] = '@', // .--.-.
+    [ 94] = '\'', // .----.
+    [ 97] = '-', // -....-
+    [106] = ';', // -.-.-.
+    [107] = '!', // -.-.--
+    [109] = ')', // -.--.-
+    [115] = ',', // --..--
+    [120] = ':', // ---...
+};
+
+// Same codes as morseTrie, indexed by character for the encoder. Units = dots + 3 * dashes + inner gaps.
+const struct MorseCharCode morseEncodeTable[MORSE_ENCODE_TABLE_SIZE] = {
+    [MORSE_PROSIGN_STARTING_SIGNAL] = { 53, 15}, // -.-.-
+    [MORSE_PROSIGN_END_OF_WORK] = { 69, 15}, // ...-.-
+    [MORSE_PROSIGN_UNDERSTOOD] = { 34, 11}, // ...-.
+    ['!'] = {107, 19}, // -.-.--
+    ['"'] = { 82, 15}, // .-..-.
+    ['&'] = { 40, 11}, // .-...
+    ['\''] = { 94, 19}, // .----.
+    ['('] = { 54, 15}, // -.--.
+    [')'] = {109, 19}, // -.--.-
+    ['+'] = { 42, 13}, // .-.-.
+    [','] = {115, 19}, // --..--
+    ['-'] = { 97, 15}, // -....-
+    ['.'] = { 85, 17}, // .-.-.-
+    ['/'] = { 50, 13}, // -..-.
+    ['0'] = { 63, 19}, // -----
+    ['1'] = { 47, 17}, // .----
+    ['2'] = { 39, 15}, // ..---
+    ['3'] = { 35, 13}, // ...--
+    ['4'] = { 33, 11}, // ....-
+    ['5'] = { 32,  9}, // .....
+    ['6'] = { 48, 11}, // -....
+    ['7'] = { 56, 13}, // --...
+    ['8'] = { 60, 15}, // ---..
+    ['9'] = { 62, 17}, // ----.
+    [':'] = {120, 17}, // ---...
+    [';'] = {106, 17}, // -.-.-.
+    ['='] = { 49, 13}, // -...-
+    ['?'] = { 76, 15}, // ..--..
+    ['@'] = { 90, 17}, // .--.-.
+    ['_'] = { 77, 17}, // ..--.-
+    ['a'] = {  5,  5}, // .-
+    ['b'] = { 24,  9}, // -...
+    ['c'] = { 26, 11}, // -.-.
+    ['d'] = { 12,  7}, // -..
+    ['e'] = {  2,  1}, // .
+    ['f'] = { 18,  9}, // ..-.
+    ['g'] = { 14,  9}, // --.
+    ['h'] = { 16,  7}, // ....
+    ['i'] = {  4,  3}, // ..
+    ['j'] = { 23, 13}, // .---
+    ['k'] = { 13,  9}, // -.-
+    ['l'] = { 20,  9}, // .-..
+    ['m'] = {  7,  7}, // --
+    ['n'] = {  6,  5}, // -.
+    ['o'] = { 15, 11}, // ---
+    ['p'] = { 22, 11}, // .--.
+    ['q'] = { 29, 13}, // --.-
+    ['r'] = { 10,  7}, // .-.
+    ['s'] = {  8,  5}, // ...
+    ['t'] = {  3,  3}, // -
+    ['u'] = {  9,  7}, // ..-
+    ['v'] = { 17,  9}, // ...-
+    ['w'] = { 11,  9}, // .--
+    ['x'] = { 25, 11}, // -..-
+    ['y'] = { 27, 13}, // -.--
+    ['z'] = { 28, 11}, // --..
+};
+
+char morse_decode(const char *code, size_t len)
+{
+    uint8_t node = MORSE_TRIE_ROOT;
+    // At most MORSE_MAX_SYMBOLS steps, one shift per dot/dash and no string compares
+    for (size_t i = 0; i < len && node != 0; i++)
+    {
+        node = morse_trie_step(node, code[i]);
+    }
+    return morse_trie_letter(node);
+}
+
+void morse_decoder_reset(struct MorseDecoder *decoder)
+{
+    decoder->node = MORSE_TRIE_ROOT;
+    decoder->lastWasSpace = 0;
+    decoder->pendingWordGap = 0;
+}
+
+int morse_decoder_push(struct MorseDecoder *decoder, char symbol, char out[MORSE_DECODER_MAX_OUTPUT])
+{
+    int written = 0;
+    if (symbol == '.' || symbol == '-')
+    {
+        // A new word starts, so the word gap read before can be emitted now
+        if (decoder->pendingWordGap)
+        {
+            out[written++] = ' ';
+            decoder->pendingWordGap = 0;
+        }
+        // Codes longer than the table end in node 0 and decode to MORSE_UNKNOWN_LETTER
+        if (decoder->node != 0)
+            decoder->node = morse_trie_step(decoder->node, symbol);
+        decoder->lastWasSpace = 0;
+    }
+    else if (symbol == ' ')
+    {
+        if (decoder->lastWasSpace)
+        {
+            // Second consecutive space -> word gap, held back so a trailing "  \n" gives no extra space
+            decoder->pendingWordGap = 1;
+        }
+        else
+        {
+            // First space -> the code is complete (a leading space has no code to decode)
+            if (decoder->node != MORSE_TRIE_ROOT)
+                out[written++] = morse_trie_letter(decoder->node);
+            decoder->node = MORSE_TRIE_ROOT;
+            decoder->lastWasSpace = 1;
+        }
+    }
+    else if (symbol == '\n' || symbol == '\0')
+    {
+        // Flush a code that was not followed by a space before the end of the message
+        if (decoder->node != MORSE_TRIE_ROOT)
+            out[written++] = morse_trie_letter(decoder->node);
+        out[written++] = '\n';
+        morse_decoder_reset(decoder);
+    }
+    return written;
+}
+
+size_t morse_translate(const char *morse, size_t len, char *out, size_t outSize)
+{
+    struct MorseDecoder decoder;
+    char decoded[MORSE_DECODER_MAX_OUTPUT];
+    size_t outLength = 0;
+    if (outSize == 0)
+        return 0;
+    morse_decoder_reset(&decoder);
+    for (size_t i = 0; i <= len; i++)
+    {
+        // Past the span the message is finished as if it had a terminator
+        char symbol = (i < len) ? morse[i] : '\0';
+        int decodedCount = morse_decoder_push(&decoder, symbol, decoded);
+        for (int j = 0; j < decodedCount && outLength < outSize - 1; j++)
+        {
+            // The end of message is not part of the translated text
+            if (decoded[j] != '\n')
+                out[outLength++] = decoded[j];
+        }
+        if (symbol == '\n' || symbol == '\0')
+            break;
+    }
+    out[outLength] = '\0';
+    return outLength;
+}
+
+void morse_packed_clear(struct MorsePacked *packed)
+{
+    packed->count = 0;
+}
+
+bool morse_packed_append(struct MorsePacked *packed, enum MorseSymbol symbol)
+{
+    if (packed->count >= MORSE_PACKED_CAPACITY)
+        return false;
+    uint16_t byteIndex = packed->count >> 2;
+    uint8_t shift = (packed->count & 3) << 1;
+    // The first symbol of a byte also clears the old content of that byte
+    if (shift == 0)
+        packed->data[byteIndex] = 0;
+    packed->data[byteIndex] |= (uint8_t)(symbol << shift);
+    packed->count++;
+    return true;
+}
+
+bool morse_packed_append_char(struct MorsePacked *packed, char character)
+{
+    switch (character)
+    {
+    case '.':
+        return morse_packed_append(packed, MORSE_SYMBOL_DOT);
+    case '-':
+        return morse_packed_append(packed, MORSE_SYMBOL_DASH);
+    case ' ':
+        if (morse_packed_last(packed) == MORSE_SYMBOL_LETTER_GAP)
+        {
+            // Second space -> upgrade the letter gap in place (both gap codes only differ in the low bit)
+            uint16_t last = packed->count - 1;
+            packed->data[last >> 2] |= (uint8_t)(1 << ((last & 3) << 1));
+            return true;
+        }
+        if (morse_packed_last(packed) == MORSE_SYMBOL_WORD_GAP)
+            return true;
+        return morse_packed_append(packed, MORSE_SYMBOL_LETTER_GAP);
+    default:
+        return false;
+    }
+}
+
+size_t morse_packed_to_text(const struct MorsePacked *packed, char *out, size_t outSize)
+{
+    static const char symbolText[4][3] = {".", "-", " ", "  "};
+    size_t length = 0;
+    if (outSize == 0)
+        return 0;
+    for (uint16_t i = 0; i < packed->count; i++)
+    {
+        const char *text = symbolText[morse_packed_get(packed, i)];
+        for (; *text && length < outSize - 1; text++)
+            out[length++] = *text;
+    }
+    out[length] = '\0';
+    return length;
+}
+
+size_t morse_packed_translate(const struct MorsePacked *packed, char *out, size_t outSize)
+{
+    static const char symbolText[4][3] = {".", "-", " ", "  "};
+    struct MorseDecoder decoder;
+    char decoded[MORSE_DECODER_MAX_OUTPUT];
+    size_t outLength = 0;
+    if (outSize == 0)
+        return 0;
+    morse_decoder_reset(&decoder);
+    for (uint32_t i = 0; i <= packed->count; i++)
+    {
+        // After the last symbol the message is finished with a terminator
+        const char *text = (i < packed->count) ? symbolText[morse_packed_get(packed, i)] : "\n";
+        for (; *text; text++)
+        {
+            int decodedCount = morse_decoder_push(&decoder, *text, decoded);
+            for (int j = 0; j < decodedCount && outLength < outSize - 1; j++)
+            {
+                if (decoded[j] != '\n')
+                    out[outLength++] = decoded[j];
+            }
+        }
+    }
+    out[outLength] = '\0';
+    return outLength;
+}
+
+size_t morse_packed_serialize(const struct MorsePacked *packed, uint8_t *out, size_t outSize)
+{
+    size_t dataSize = MORSE_PACKED_BYTES(packed->count);
+    if (outSize < MORSE_PACKED_HEADER_SIZE + dataSize)
+        return 0;
+    out[0] = (uint8_t)(packed->count >> 8);
+    out[1] = (uint8_t)(packed->count & 0xFF);
+    // Unused bits of the last byte are always 0 (morse_packed_append clears each new byte)
+    memcpy(&out[MORSE_PACKED_HEADER_SIZE], packed->data, dataSize);
+    return MORSE_PACKED_HEADER_SIZE + dataSize;
+}
+
+size_t morse_packed_deserialize(struct MorsePacked *packed, const uint8_t *in, size_t inSize)
+{
+    if (inSize < MORSE_PACKED_HEADER_SIZE)
+        return 0;
+    uint16_t count = (uint16_t)((in[0] << 8) | in[1]);
+    size_t dataSize = MORSE_PACKED_BYTES(count);
+    if (count > MORSE_PACKED_CAPACITY || inSize < MORSE_PACKED_HEADER_SIZE + dataSize)
+        return 0;
+    packed->count = count;
+    memcpy(packed->data, &in[MORSE_PACKED_HEADER_SIZE], dataSize);
+    return MORSE_PACKED_HEADER_SIZE + dataSize;
+}
+
+void morse_schedule_reset(struct MorseSchedule *schedule, uint16_t wpm)
+{
+    schedule->count = 0;
+    schedule->unitMs = morse_unit_ms(wpm);
+    schedule->totalMs = 0;
+}
+
+// Make the gap after the last event at least gapUnits long.
+static void morse_schedule_extend_gap(struct MorseSchedule *schedule, uint16_t gapUnits)
+{
+    if (schedule->count == 0)
+        return;
+    struct MorseEvent *last = &schedule->events[schedule->count - 1];
+    uint16_t gapMs = (uint16_t)(gapUnits * schedule->unitMs);
+    if (last->offMs < gapMs)
+    {
+        schedule->totalMs += gapMs - last->offMs;
+        last->offMs = gapMs;
+    }
+}
+
+// Append the dots/dashes of a trie node, the first event carries the letter.
+static bool morse_schedule_append_node(struct MorseSchedule *schedule, uint8_t node, char letter)
+{
+    // The code is the bits below the leading 1 of the node, first symbol in the highest bit
+    int length = 0;
+    while ((node >> (length + 1)) != 0)
+        length++;
+    if (length == 0 || schedule->count + length > MORSE_SCHEDULE_CAPACITY)
+        return false;
+    for (int i = length - 1; i >= 0; i--)
+    {
+        struct MorseEvent *event = &schedule->events[schedule->count++];
+        event->symbol = ((node >> i) & 1) ? MORSE_SYMBOL_DASH : MORSE_SYMBOL_DOT;
+        event->onMs = (uint16_t)((event->symbol == MORSE_SYMBOL_DASH ? MORSE_DASH_UNITS : MORSE_DOT_UNITS) * schedule->unitMs);
+        event->offMs = (uint16_t)((i == 0 ? MORSE_LETTER_GAP_UNITS : MORSE_ELEMENT_GAP_UNITS) * schedule->unitMs);
+        event->letter = (i == length - 1) ? letter : 0;
+        schedule->totalMs += event->onMs + event->offMs;
+    }
+    return true;
+}
+
+bool morse_schedule_append_char(struct MorseSchedule *schedule, char character)
+{
+    if (character == ' ')
+    {
+        // A word gap only separates letters, leading spaces have nothing to separate
+        morse_schedule_extend_gap(schedule, MORSE_WORD_GAP_UNITS);
+        return true;
+    }
+    const struct MorseCharCode *code = morse_encode_char(character);
+    if (code == NULL)
+        return false;
+    return morse_schedule_append_node(schedule, code->node, morseTrie[code->node]);
+}
+
+size_t morse_schedule_append_text(struct MorseSchedule *schedule, const char *text, size_t len)
+{
+    size_t encoded = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (morse_schedule_append_char(schedule, text[i]))
+            encoded++;
+    }
+    return encoded;
+}
+
+bool morse_schedule_from_packed(struct MorseSchedule *schedule, const struct MorsePacked *packed, uint16_t wpm)
+{
+    uint8_t node = MORSE_TRIE_ROOT;
+    uint16_t letterStart = 0;
+    morse_schedule_reset(schedule, wpm);
+    for (uint32_t i = 0; i <= packed->count; i++)
+    {
+        // After the last symbol the message ends like a letter gap
+        enum MorseSymbol symbol = (i < packed->count) ? morse_packed_get(packed, i) : MORSE_SYMBOL_LETTER_GAP;
+        if (symbol == MORSE_SYMBOL_DOT || symbol == MORSE_SYMBOL_DASH)
+        {
+            if (schedule->count >= MORSE_SCHEDULE_CAPACITY)
+                return false;
+            if (node == MORSE_TRIE_ROOT)
+                letterStart = schedule->count;
+            struct MorseEvent *event = &schedule->events[schedule->count++];
+            event->symbol = (uint8_t)symbol;
+            event->onMs = (uint16_t)((symbol == MORSE_SYMBOL_DASH ? MORSE_DASH_UNITS : MORSE_DOT_UNITS) * schedule->unitMs);
+            event->offMs = (uint16_t)(MORSE_ELEMENT_GAP_UNITS * schedule->unitMs);
+            event->letter = 0;
+            schedule->totalMs += event->onMs + event->offMs;
+            // Codes longer than the table stay on node 0 and decode to MORSE_UNKNOWN_LETTER
+            node = morse_trie_step(node, symbol == MORSE_SYMBOL_DASH ? '-' : '.');
+            continue;
+        }
+        if (node != MORSE_TRIE_ROOT)
+        {
+            // The code is complete -> put its letter on its first event
+            schedule->events[letterStart].letter = morse_trie_letter(node);
+            node = MORSE_TRIE_ROOT;
+        }
+        morse_schedule_extend_gap(schedule, symbol == MORSE_SYMBOL_WORD_GAP ? MORSE_WORD_GAP_UNITS : MORSE_LETTER_GAP_UNITS);
+    }
+    return true;
+}
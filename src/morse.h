@@ -0,0 +1,224 @@
+#ifndef MORSE_H
+#define MORSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest supported morse code (ITU punctuation such as ".-.-.-" has 6 symbols)
+#define MORSE_MAX_SYMBOLS 6
+// The decode trie is stored as an implicit binary tree: root = 1, dot -> 2n, dash -> 2n + 1
+#define MORSE_TRIE_ROOT 1
+#define MORSE_TRIE_SIZE (1 << (MORSE_MAX_SYMBOLS + 1))
+// Letter returned when the code is not part of the table (kept from the old linear search)
+#define MORSE_UNKNOWN_LETTER 'n'
+
+// ITU prosigns have no printable letter, so they are decoded to the matching ASCII control code
+#define MORSE_PROSIGN_STARTING_SIGNAL '\x02' // -.-.-  (CT)
+#define MORSE_PROSIGN_END_OF_WORK '\x04'     // ...-.- (SK)
+#define MORSE_PROSIGN_UNDERSTOOD '\x06'      // ...-.  (SN)
+
+// Decode table indexed by trie node, 0 means no letter on that node.
+extern const char morseTrie[MORSE_TRIE_SIZE];
+
+// Move one dot/dash down the trie. Returns 0 when the code gets too long or the symbol is not a dot/dash.
+static inline uint8_t morse_trie_step(uint8_t node, char symbol)
+{
+    if (node == 0 || node >= (MORSE_TRIE_SIZE >> 1))
+        return 0;
+    if (symbol == '.')
+        return (uint8_t)(node << 1);
+    if (symbol == '-')
+        return (uint8_t)((node << 1) | 1);
+    return 0;
+}
+
+// Get the letter stored on a trie node, or MORSE_UNKNOWN_LETTER if there is none.
+static inline char morse_trie_letter(uint8_t node)
+{
+    char letter = (node < MORSE_TRIE_SIZE) ? morseTrie[node] : 0;
+    return letter ? letter : MORSE_UNKNOWN_LETTER;
+}
+
+// Decode one morse code (len dots/dashes, no separators) to its letter.
+char morse_decode(const char *code, size_t len);
+
+// Most characters one call of morse_decoder_push() can emit
+#define MORSE_DECODER_MAX_OUTPUT 2
+
+// Resumable decoder state, fed one symbol at a time.
+struct MorseDecoder
+{
+    uint8_t node;           // Trie node of the code being read, MORSE_TRIE_ROOT when empty
+    uint8_t lastWasSpace;   // The previous symbol was a space (a letter gap)
+    uint8_t pendingWordGap; // Two spaces were read, emit ' ' when the next word starts
+};
+
+// Reset the decoder to the start of a message.
+void morse_decoder_reset(struct MorseDecoder *decoder);
+
+// Feed one symbol: '.' or '-' extend the current code, ' ' ends a letter, two spaces end a word and
+// '\n' or '\0' end the message. Decoded characters are written to out (message end is reported as '\n').
+// Returns how many characters were written (0..MORSE_DECODER_MAX_OUTPUT). Other symbols are ignored.
+int morse_decoder_push(struct MorseDecoder *decoder, char symbol, char out[MORSE_DECODER_MAX_OUTPUT]);
+
+// Translate the morse text morse[0..len) to letters. Reading stops at len or at the first '\n'/'\0',
+// so nothing past the message end is read. The result in out is always null terminated and is cut
+// to outSize - 1 characters. Returns the decoded length (without the terminator).
+size_t morse_translate(const char *morse, size_t len, char *out, size_t outSize);
+
+// Packed morse message: every symbol takes 2 bits, 4 symbols per byte (first symbol in the low bits).
+// A word gap is one symbol, in text it is written as two spaces.
+enum MorseSymbol
+{
+    MORSE_SYMBOL_DOT = 0,
+    MORSE_SYMBOL_DASH = 1,
+    MORSE_SYMBOL_LETTER_GAP = 2,
+    MORSE_SYMBOL_WORD_GAP = 3
+};
+
+// Maximum symbols in one packed message (same as the old 502 character buffers)
+#define MORSE_PACKED_CAPACITY 502
+#define MORSE_PACKED_BYTES(symbols) (((symbols) + 3) / 4)
+// Serialized form: 2 byte big-endian symbol count followed by the packed bytes
+#define MORSE_PACKED_HEADER_SIZE 2
+#define MORSE_PACKED_SERIALIZED_MAX (MORSE_PACKED_HEADER_SIZE + MORSE_PACKED_BYTES(MORSE_PACKED_CAPACITY))
+// Longest text form of a packed message (every symbol a word gap) plus the terminator
+#define MORSE_PACKED_TEXT_MAX (2 * MORSE_PACKED_CAPACITY + 1)
+
+struct MorsePacked
+{
+    uint16_t count;                                     // Number of symbols stored
+    uint8_t data[MORSE_PACKED_BYTES(MORSE_PACKED_CAPACITY)]; // 2 bits per symbol
+};
+
+// Empty the message.
+void morse_packed_clear(struct MorsePacked *packed);
+
+// Append a symbol. Returns false (and keeps the message unchanged) when the message is full.
+bool morse_packed_append(struct MorsePacked *packed, enum MorseSymbol symbol);
+
+// Append a text character: '.', '-' or ' '. A space right after a letter gap turns it into a word gap.
+// Returns false if the character is not a morse character or the message is full.
+bool morse_packed_append_char(struct MorsePacked *packed, char character);
+
+// Read the symbol at index (index < packed->count).
+static inline enum MorseSymbol morse_packed_get(const struct MorsePacked *packed, uint16_t index)
+{
+    return (enum MorseSymbol)((packed->data[index >> 2] >> ((index & 3) << 1)) & 0x3);
+}
+
+// Text character of a symbol ('.', '-' or ' ' for both gaps).
+static inline char morse_symbol_to_char(enum MorseSymbol symbol)
+{
+    return symbol == MORSE_SYMBOL_DOT ? '.' : symbol == MORSE_SYMBOL_DASH ? '-' : ' ';
+}
+
+// Number of spaces a symbol stands for in text (0 for dot/dash, 1 letter gap, 2 word gap).
+static inline int morse_symbol_spaces(enum MorseSymbol symbol)
+{
+    return symbol == MORSE_SYMBOL_WORD_GAP ? 2 : symbol == MORSE_SYMBOL_LETTER_GAP ? 1 : 0;
+}
+
+// Get the last symbol, or -1 when the message is empty.
+static inline int morse_packed_last(const struct MorsePacked *packed)
+{
+    return packed->count ? (int)morse_packed_get(packed, packed->count - 1) : -1;
+}
+
+// Write the message as text ('.', '-', ' ', "  "), null terminated. Returns the text length.
+size_t morse_packed_to_text(const struct MorsePacked *packed, char *out, size_t outSize);
+
+// Translate the message to letters like morse_translate(). Returns the decoded length.
+size_t morse_packed_translate(const struct MorsePacked *packed, char *out, size_t outSize);
+
+// Write the wire format (count + packed bytes). Returns the written size or 0 if out is too small.
+size_t morse_packed_serialize(const struct MorsePacked *packed, uint8_t *out, size_t outSize);
+
+// Read the wire format. Returns the consumed size or 0 if the data is truncated or too long.
+size_t morse_packed_deserialize(struct MorsePacked *packed, const uint8_t *in, size_t inSize);
+
+// Encoder: text -> schedule of timed (on, off) events with PARIS timing. One unit is 1200 / WPM ms,
+// a dot is 1 unit, a dash 3, the gap inside a letter 1, between letters 3 and between words 7.
+#define MORSE_DEFAULT_WPM 20
+#define MORSE_DOT_UNITS 1
+#define MORSE_DASH_UNITS 3
+#define MORSE_ELEMENT_GAP_UNITS 1
+#define MORSE_LETTER_GAP_UNITS 3
+#define MORSE_WORD_GAP_UNITS 7
+// The encode table covers 7-bit ASCII (upper case letters are encoded as lower case)
+#define MORSE_ENCODE_TABLE_SIZE 128
+// Most events in one schedule (one event per dot/dash)
+#define MORSE_SCHEDULE_CAPACITY 512
+
+// Code of one character: its trie node (0 = no morse code) and its length in units without the gap after it.
+struct MorseCharCode
+{
+    uint8_t node;
+    uint8_t units;
+};
+
+// Encode table indexed by ASCII character, built at compile time from the same codes as morseTrie.
+extern const struct MorseCharCode morseEncodeTable[MORSE_ENCODE_TABLE_SIZE];
+
+// Length of one unit in ms for the given speed (PARIS: 50 units per word).
+static inline uint16_t morse_unit_ms(uint16_t wpm)
+{
+    return (uint16_t)(1200 / (wpm ? wpm : MORSE_DEFAULT_WPM));
+}
+
+// Get the code of a character, or NULL if it has no morse code.
+static inline const struct MorseCharCode *morse_encode_char(char character)
+{
+    unsigned char index = (unsigned char)character;
+    if (index >= 'A' && index <= 'Z')
+        index = (unsigned char)(index - 'A' + 'a');
+    if (index >= MORSE_ENCODE_TABLE_SIZE || morseEncodeTable[index].node == 0)
+        return NULL;
+    return &morseEncodeTable[index];
+}
+
+// One dot or dash: the output is on for onMs and then off for offMs (the gap after it).
+struct MorseEvent
+{
+    uint16_t onMs;
+    uint16_t offMs;
+    uint8_t symbol; // MORSE_SYMBOL_DOT or MORSE_SYMBOL_DASH
+    char letter;    // Letter that starts with this event, 0 on the other events of the letter
+};
+
+struct MorseSchedule
+{
+    uint16_t count;   // Number of events
+    uint16_t unitMs;  // Unit length the durations were computed with
+    uint32_t totalMs; // Play time of the whole schedule
+    struct MorseEvent events[MORSE_SCHEDULE_CAPACITY];
+};
+
+// Empty the schedule and set its speed (0 -> MORSE_DEFAULT_WPM).
+void morse_schedule_reset(struct MorseSchedule *schedule, uint16_t wpm);
+
+// Check if a character of the longest code may no longer fit.
+static inline bool morse_schedule_is_full(const struct MorseSchedule *schedule)
+{
+    return schedule->count > MORSE_SCHEDULE_CAPACITY - MORSE_MAX_SYMBOLS;
+}
+
+// Append one text character, ' ' is a word gap. Returns false (schedule unchanged) if the character has
+// no morse code or does not fit.
+bool morse_schedule_append_char(struct MorseSchedule *schedule, char character);
+
+// Append text[0..len) and return how many characters were encoded.
+size_t morse_schedule_append_text(struct MorseSchedule *schedule, const char *text, size_t len);
+
+// Build the schedule of a packed morse message, the letters are decoded with the trie.
+// Returns false if the message did not fit completely.
+bool morse_schedule_from_packed(struct MorseSchedule *schedule, const struct MorsePacked *packed, uint16_t wpm);
+
+// Check if a word gap comes right before the event (the lcd shows a space there).
+static inline bool morse_schedule_word_starts(const struct MorseSchedule *schedule, uint16_t index)
+{
+    return index > 0 && schedule->events[index - 1].offMs >= MORSE_WORD_GAP_UNITS * schedule->unitMs;
+}
+
+#endif
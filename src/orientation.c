@@ -0,0 +1,136 @@
+#include "orientation.h"
+
+// Fraction bits of the running angles
+#define ORIENTATION_Q 8
+#define ORIENTATION_ATAN_STEPS 64
+
+// atan(i / 64) in 0.01°, the first octant of atan2 with linear interpolation between the entries (error < 0.02°)
+static const int16_t atanTable[ORIENTATION_ATAN_STEPS + 1] = {
+    0, 90, 179, 268, 358, 447, 536, 624, 713,
+    800, 888, 975, 1062, 1148, 1234, 1319, 1404, 1488,
+    1571, 1653, 1735, 1817, 1897, 1977, 2056, 2134, 2211,
+    2287, 2363, 2438, 2511, 2584, 2657, 2728, 2798, 2867,
+    2936, 3003, 3070, 3136, 3201, 3264, 3327, 3390, 3451,
+    3511, 3571, 3629, 3687, 3744, 3800, 3855, 3909, 3963,
+    4016, 4067, 4119, 4169, 4218, 4267, 4315, 4363, 4409,
+    4455, 4500,
+};
+
+// atan2(y, x) in 0.01°, -180° < result <= 180°
+static int32_t orientation_atan2(int32_t y, int32_t x)
+{
+    uint32_t ay = y < 0 ? (uint32_t)-y : (uint32_t)y;
+    uint32_t ax = x < 0 ? (uint32_t)-x : (uint32_t)x;
+    if (ax == 0 && ay == 0)
+        return 0;
+    // Angle of the smaller over the larger one, 0° .. 45°. Both are below 2^16, so the Q16 ratio fits.
+    uint32_t ratio = ay <= ax ? (ay << 16) / ax : (ax << 16) / ay;
+    uint32_t index = ratio >> 10;
+    uint32_t fraction = ratio & 0x3FF;
+    int32_t angle = atanTable[index];
+    if (index < ORIENTATION_ATAN_STEPS)
+        angle += ((atanTable[index + 1] - atanTable[index]) * (int32_t)fraction) >> 10;
+    // Unfold the octant, then the quadrant
+    if (ay > ax)
+        angle = ORIENTATION_QUARTER_TURN - angle;
+    if (x < 0)
+        angle = 2 * ORIENTATION_QUARTER_TURN - angle;
+    return y < 0 ? -angle : angle;
+}
+
+static uint32_t orientation_isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value)
+        bit >>= 2;
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Keep a Q8 angle in -180° .. 180°
+static int32_t orientation_wrap(int32_t angle)
+{
+    const int32_t halfTurn = (int32_t)ORIENTATION_HALF_TURN << ORIENTATION_Q;
+    if (angle > halfTurn)
+        angle -= 2 * halfTurn;
+    else if (angle < -halfTurn)
+        angle += 2 * halfTurn;
+    return angle;
+}
+
+void orientation_init(struct OrientationFilter *filter, uint16_t accelLsbPerG, uint16_t gyroLsbPerDpsX10,
+                      uint16_t odrHz, uint8_t accelShift)
+{
+    // 1 count = 10 / gyroLsbPerDpsX10 dps, one sample lasts 1 / odrHz s
+    filter->gyroToAngleQ16 = (int32_t)((1000u << 16) / ((uint32_t)gyroLsbPerDpsX10 * odrHz));
+    // The accelerometer only measures the tilt when it is not moved: its norm must be 0.75 g .. 1.25 g
+    uint32_t accelMin = (uint32_t)accelLsbPerG * 3 / 4;
+    uint32_t accelMax = (uint32_t)accelLsbPerG * 5 / 4;
+    filter->accelMinSq = accelMin * accelMin;
+    filter->accelMaxSq = accelMax * accelMax;
+    filter->accelShift = accelShift;
+    orientation_reset(filter);
+}
+
+void orientation_reset(struct OrientationFilter *filter)
+{
+    filter->started = false;
+    filter->roll = 0;
+    filter->pitch = 0;
+    filter->yaw = 0;
+}
+
+struct OrientationAngles orientation_update(struct OrientationFilter *filter, const int16_t accel[3], const int16_t gyro[3])
+{
+    int32_t ax = accel[0], ay = accel[1], az = accel[2];
+    uint32_t ayzSq = (uint32_t)(ay * ay) + (uint32_t)(az * az);
+    uint32_t normSq = ayzSq + (uint32_t)(ax * ax);
+
+    if (!filter->started)
+    {
+        // Start from the gravity direction
+        filter->roll = orientation_atan2(ay, az) << ORIENTATION_Q;
+        filter->pitch = orientation_atan2(-ax, (int32_t)orientation_isqrt(ayzSq)) << ORIENTATION_Q;
+        filter->started = true;
+    }
+    else
+    {
+        // Predict with the gyroscope
+        filter->roll = orientation_wrap(filter->roll + ((gyro[0] * filter->gyroToAngleQ16) >> (16 - ORIENTATION_Q)));
+        filter->pitch += (gyro[1] * filter->gyroToAngleQ16) >> (16 - ORIENTATION_Q);
+        // Correct with the accelerometer tilt, unless the board is being moved (shake, fast gestures)
+        if (normSq >= filter->accelMinSq && normSq <= filter->accelMaxSq)
+        {
+            int32_t roll = orientation_atan2(ay, az) << ORIENTATION_Q;
+            int32_t pitch = orientation_atan2(-ax, (int32_t)orientation_isqrt(ayzSq)) << ORIENTATION_Q;
+            filter->roll = orientation_wrap(filter->roll + (orientation_wrap(roll - filter->roll) >> filter->accelShift));
+            filter->pitch += (pitch - filter->pitch) >> filter->accelShift;
+        }
+        const int32_t quarterTurn = (int32_t)ORIENTATION_QUARTER_TURN << ORIENTATION_Q;
+        if (filter->pitch > quarterTurn)
+            filter->pitch = quarterTurn;
+        else if (filter->pitch < -quarterTurn)
+            filter->pitch = -quarterTurn;
+    }
+    // Nothing to correct the heading with: gyroscope only
+    filter->yaw = orientation_wrap(filter->yaw + ((gyro[2] * filter->gyroToAngleQ16) >> (16 - ORIENTATION_Q)));
+
+    struct OrientationAngles angles = {
+        (int16_t)(filter->roll >> ORIENTATION_Q),
+        (int16_t)(filter->pitch >> ORIENTATION_Q),
+        (int16_t)(filter->yaw >> ORIENTATION_Q)};
+    return angles;
+}
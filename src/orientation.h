@@ -0,0 +1,45 @@
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Angles are in hundredths of a degree
+#define ORIENTATION_UNITS_PER_DEGREE 100
+#define ORIENTATION_HALF_TURN (180 * ORIENTATION_UNITS_PER_DEGREE)
+#define ORIENTATION_QUARTER_TURN (90 * ORIENTATION_UNITS_PER_DEGREE)
+
+// Roll, pitch and yaw of the board in 0.01°. Flat and face up is 0, 0.
+struct OrientationAngles
+{
+    int16_t roll;  // Around x, -180° .. 180°
+    int16_t pitch; // Around y, -90° .. 90°
+    int16_t yaw;   // Around z, integrated gyroscope only: relative to the reset and it drifts
+};
+
+// Complementary filter in fixed point: the gyroscope is integrated every sample, and the accelerometer tilt
+// pulls the result back by 1 / 2^accelShift of the error, which removes the gyroscope drift.
+struct OrientationFilter
+{
+    int32_t gyroToAngleQ16;  // 0.01° turned in one sample by 1 gyroscope count, Q16
+    uint32_t accelMinSq;     // Squared accelerometer norm accepted as gravity only (raw counts)
+    uint32_t accelMaxSq;
+    uint8_t accelShift;
+    bool started;            // The first sample sets the angles from the accelerometer alone
+    int32_t roll;            // Running angles in 0.01°, Q8
+    int32_t pitch;
+    int32_t yaw;
+};
+
+// Set up the filter for the sensor sensitivity and output data rate, and reset it. accelShift sets the time
+// constant: 2^accelShift samples (5 gives 160 ms at 200 Hz).
+void orientation_init(struct OrientationFilter *filter, uint16_t accelLsbPerG, uint16_t gyroLsbPerDpsX10,
+                      uint16_t odrHz, uint8_t accelShift);
+
+// Forget the angles, the next sample starts again from the accelerometer tilt.
+void orientation_reset(struct OrientationFilter *filter);
+
+// Add one raw sample and return the new angles. Only integer math and one table lookup per angle.
+struct OrientationAngles orientation_update(struct OrientationFilter *filter, const int16_t accel[3], const int16_t gyro[3]);
+
+#endif
@@ -0,0 +1,98 @@
+#include <hardware/timer.h>
+
+#include "tkjhat/sdk.h"
+#include "playback.h"
+
+// State of the running timeline, only touched by playback_start() and the alarm interruption
+static struct
+{
+    const struct MorseSchedule *schedule;
+    uint16_t index;            // Event being played
+    bool eventOn;              // In the on part of the event (otherwise in the gap after it)
+    absolute_time_t nextTime;  // Start time of the next step, all steps are relative to the first one
+    volatile bool running;
+} timeline;
+
+static int playbackAlarm = -1;
+static playback_letter_callback_t letterCallback;
+static playback_finished_callback_t finishedCallback;
+
+// Do every step that is due, then set the alarm on the next one. Runs in the timer interruption.
+static void playback_alarm_callback(uint alarmNum)
+{
+    do
+    {
+        const struct MorseSchedule *schedule = timeline.schedule;
+        if (!timeline.eventOn)
+        {
+            if (timeline.index >= schedule->count)
+            {
+                // Last gap ended, the queued tones can play again
+                buzzer_release();
+                rgb_led_write(0, 0, 0);
+                timeline.running = false;
+                if (finishedCallback)
+                    finishedCallback();
+                return;
+            }
+            // The on part of an event: the buzzer, the rgb and the lcd change on the same tick
+            const struct MorseEvent *event = &schedule->events[timeline.index];
+            if (event->symbol == MORSE_SYMBOL_DOT)
+                rgb_led_write(PLAYBACK_DOT_RGB);
+            else
+                rgb_led_write(PLAYBACK_DASH_RGB);
+            buzzer_set_tone(PLAYBACK_TONE_HZ);
+            if (letterCallback && morse_schedule_word_starts(schedule, timeline.index))
+                letterCallback(' ');
+            if (letterCallback && event->letter)
+                letterCallback(event->letter);
+            timeline.eventOn = true;
+            timeline.nextTime = delayed_by_us(timeline.nextTime, (uint64_t)event->onMs * 1000);
+        }
+        else
+        {
+            // The gap after the event
+            const struct MorseEvent *event = &schedule->events[timeline.index];
+            rgb_led_write(0, 0, 0);
+            buzzer_set_tone(0);
+            timeline.eventOn = false;
+            timeline.index++;
+            timeline.nextTime = delayed_by_us(timeline.nextTime, (uint64_t)event->offMs * 1000);
+        }
+        // set_target returns true when the time already passed, then the step is done right away
+    } while (hardware_alarm_set_target(alarmNum, timeline.nextTime));
+}
+
+bool playback_init(playback_letter_callback_t onLetter, playback_finished_callback_t onFinished)
+{
+    letterCallback = onLetter;
+    finishedCallback = onFinished;
+    playbackAlarm = hardware_alarm_claim_unused(false);
+    if (playbackAlarm < 0)
+        return false;
+    hardware_alarm_set_callback((uint)playbackAlarm, playback_alarm_callback);
+    return true;
+}
+
+bool playback_start(const struct MorseSchedule *schedule)
+{
+    if (playbackAlarm < 0 || timeline.running)
+        return false;
+    // The queued tones wait until the end, nothing else drives the buzzer during the message
+    if (!buzzer_claim())
+        return false;
+    timeline.schedule = schedule;
+    timeline.index = 0;
+    timeline.eventOn = false;
+    timeline.running = true;
+    // Every step time is computed from this one, so the outputs do not drift during the message
+    timeline.nextTime = make_timeout_time_us(PLAYBACK_LEAD_US);
+    if (hardware_alarm_set_target((uint)playbackAlarm, timeline.nextTime))
+        playback_alarm_callback((uint)playbackAlarm);
+    return true;
+}
+
+bool playback_is_running(void)
+{
+    return timeline.running;
+}
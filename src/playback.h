@@ -0,0 +1,32 @@
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "morse.h"
+
+// Tone of the buzzer and colors of the rgb during a dot/dash
+#define PLAYBACK_TONE_HZ 440
+#define PLAYBACK_DOT_RGB 0, 0, 255  // blue
+#define PLAYBACK_DASH_RGB 0, 255, 0 // green
+// Time between playback_start() and the first event, so every output starts on the same timer tick
+#define PLAYBACK_LEAD_US 2000
+
+// Called from the timer interruption: a letter starts (letter != 0) or a word gap before it (letter == ' ').
+typedef void (*playback_letter_callback_t)(char letter);
+// Called from the timer interruption when the last event of the schedule ended.
+typedef void (*playback_finished_callback_t)(void);
+
+// Claim a hardware alarm (init_buzzer() must have set up the buzzer PWM). Returns false if no alarm is free.
+bool playback_init(playback_letter_callback_t onLetter, playback_finished_callback_t onFinished);
+
+// Start playing the schedule on the buzzer and the rgb from one hardware timer. The buzzer is claimed until the
+// end (buzzer_claim()), the queued tones wait meanwhile. The schedule must not change until the finished callback
+// was called. Returns false if a playback is already running or the buzzer is claimed by someone else.
+bool playback_start(const struct MorseSchedule *schedule);
+
+// Check if a schedule is being played.
+bool playback_is_running(void);
+
+#endif
@@ -0,0 +1,47 @@
+#include <pico/stdio.h>
+
+#include "serial_rx.h"
+
+static TaskHandle_t serialRxTask = NULL;
+
+void serial_rx_wake(void)
+{
+    if (serialRxTask == NULL)
+        return;
+    if (portCHECK_IF_IN_ISR())
+    {
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(serialRxTask, &higherPriorityTaskWoken);
+        portYIELD_FROM_ISR(higherPriorityTaskWoken);
+    }
+    else
+    {
+        xTaskNotifyGive(serialRxTask);
+    }
+}
+
+// Called by the usb stdio driver (from its interruption) when received bytes are waiting in its buffer
+static void serial_rx_chars_available(void *param)
+{
+    (void)param;
+    serial_rx_wake();
+}
+
+void serial_rx_init(TaskHandle_t consumer)
+{
+    serialRxTask = consumer;
+    stdio_set_chars_available_callback(serial_rx_chars_available, NULL);
+}
+
+int serial_rx_read(char *buf, int len, TickType_t timeout)
+{
+    // Take everything the usb buffer already holds (up to len) without waiting
+    int received = stdio_get_until(buf, len, get_absolute_time());
+    if (received > 0)
+        return received;
+    // Nothing there -> sleep until the callback says bytes arrived
+    if (ulTaskNotifyTake(pdTRUE, timeout) == 0)
+        return 0;
+    received = stdio_get_until(buf, len, get_absolute_time());
+    return received > 0 ? received : 0;
+}
@@ -0,0 +1,21 @@
+#ifndef SERIAL_RX_H
+#define SERIAL_RX_H
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+// Bytes the receive task takes from the usb buffer in one read
+#define SERIAL_RX_CHUNK_SIZE 64
+
+// Register the task that reads the serial input. The usb "chars available" callback then wakes it
+// with a task notification, so it does not have to poll.
+void serial_rx_init(TaskHandle_t consumer);
+
+// Read up to len bytes that are already received, in one call. If there are none, block until the usb
+// callback (or serial_rx_wake) signals new data or the timeout passes. Returns the number of bytes read.
+int serial_rx_read(char *buf, int len, TickType_t timeout);
+
+// Wake the consumer task from any context (task or interruption), e.g. when another input is ready.
+void serial_rx_wake(void);
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <pico/stdio.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <stream_buffer.h>
+#include <task.h>
+
+#include "telemetry.h"
+
+// Frames waiting for the usb serial, written by the sensor tasks and read by the writer task
+static StreamBufferHandle_t telemetryRing = NULL;
+// The stream buffer takes one writer at a time: the sensor tasks build and queue their frames under this mutex
+static SemaphoreHandle_t telemetryMutex = NULL;
+static uint8_t telemetrySequence = 0;
+static volatile uint32_t telemetryDropped = 0;
+
+static void telemetry_task(void *pvParameters)
+{
+    (void)pvParameters;
+
+    // Static: too big for the task stack
+    static uint8_t chunk[TELEMETRY_WRITE_CHUNK];
+    while (1)
+    {
+        // Wake up for a batch of frames, or to flush what is left after a pause
+        size_t length = xStreamBufferReceive(telemetryRing, chunk, sizeof(chunk), pdMS_TO_TICKS(TELEMETRY_FLUSH_MS));
+        if (length == 0)
+            continue;
+        // One write for the whole batch: a stdio write is not split by the printf of another task.
+        // Raw bytes: the CRLF translation of stdout would add a 0x0D before every 0x0A byte of the frames
+        stdio_put_string((const char *)chunk, (int)length, false, false);
+        stdio_flush();
+    }
+}
+
+bool telemetry_init(UBaseType_t writerPriority)
+{
+    telemetryRing = xStreamBufferCreate(TELEMETRY_RING_SIZE, TELEMETRY_TRIGGER_LEVEL);
+    telemetryMutex = xSemaphoreCreateMutex();
+    if (telemetryRing == NULL || telemetryMutex == NULL)
+        return false;
+    return xTaskCreate(telemetry_task, "TelemetryTask", 512, NULL, writerPriority, NULL) == pdPASS;
+}
+
+bool telemetry_send(uint8_t type, const uint8_t *payload, uint8_t length)
+{
+    if (telemetryRing == NULL || length > TELEMETRY_MAX_PAYLOAD)
+        return false;
+
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    size_t frameLength = TELEMETRY_HEADER_SIZE + length + TELEMETRY_CRC_SIZE;
+    frame[0] = TELEMETRY_SYNC0;
+    frame[1] = TELEMETRY_SYNC1;
+    frame[2] = type;
+    frame[3] = length;
+    for (uint8_t i = 0; i < length; i++)
+        frame[TELEMETRY_HEADER_SIZE + i] = payload[i];
+
+    bool sent = false;
+    xSemaphoreTake(telemetryMutex, portMAX_DELAY);
+    // A whole frame or nothing: the decoder resynchronizes on the sync bytes, but a cut frame is lost anyway
+    if (xStreamBufferSpacesAvailable(telemetryRing) >= frameLength)
+    {
+        frame[4] = telemetrySequence;
+        telemetry_put_u16(&frame[TELEMETRY_HEADER_SIZE + length], telemetry_crc16(&frame[2], 3 + length));
+        sent = xStreamBufferSend(telemetryRing, frame, frameLength, 0) == frameLength;
+    }
+    // The sequence also counts the dropped frames so the decoder sees the gap
+    telemetrySequence++;
+    if (!sent)
+        telemetryDropped++;
+    xSemaphoreGive(telemetryMutex);
+    return sent;
+}
+
+uint32_t telemetry_dropped(void)
+{
+    return telemetryDropped;
+}
@@ -0,0 +1,29 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+
+#include "telemetry_format.h"
+
+// Bytes of frames the ring holds before new frames are dropped
+#define TELEMETRY_RING_SIZE 1024
+// Bytes the writer task sends to the usb serial in one write
+#define TELEMETRY_WRITE_CHUNK 256
+// The writer waits for this many bytes, or TELEMETRY_FLUSH_MS, before writing
+#define TELEMETRY_TRIGGER_LEVEL 96
+#define TELEMETRY_FLUSH_MS 50
+
+// Create the frame ring and the task that writes it to the usb serial. Returns false if they cannot be allocated.
+bool telemetry_init(UBaseType_t writerPriority);
+
+// Build one frame and queue it, without blocking on the usb. Task context only. Returns false, and counts the
+// frame as dropped, if the ring has no room for the whole frame.
+bool telemetry_send(uint8_t type, const uint8_t *payload, uint8_t length);
+
+// Frames dropped because the ring was full
+uint32_t telemetry_dropped(void);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary telemetry frame, little endian:
+//
+//   0xA5 0x5A | type | length | sequence | payload (length bytes) | crc16
+//
+// The sequence counts every frame (wraps at 256) so the decoder sees dropped frames. The CRC-16/CCITT covers type
+// to the end of the payload. The frames share the usb serial port with the text logs: a decoder looks for the sync
+// bytes and keeps only the frames whose CRC matches. Written by telemetry.c, read by tools/host/telemetry_decode.c.
+
+#define TELEMETRY_SYNC0 0xA5
+#define TELEMETRY_SYNC1 0x5A
+#define TELEMETRY_HEADER_SIZE 5
+#define TELEMETRY_CRC_SIZE 2
+#define TELEMETRY_MAX_PAYLOAD 32
+#define TELEMETRY_MAX_FRAME (TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_PAYLOAD + TELEMETRY_CRC_SIZE)
+
+enum TelemetryType
+{
+    TELEMETRY_IMU_SCALE = 1, // A reading starts: u16 odr_hz, u16 accel_lsb_per_g, u16 gyro_lsb_per_dps_x10
+    TELEMETRY_IMU_SAMPLE,    // u32 time_us, i16 ax, ay, az, gx, gy, gz, i8 temperature (raw FIFO counts)
+    TELEMETRY_LIGHT          // u32 time_ms, u32 lux
+};
+
+#define TELEMETRY_IMU_SCALE_SIZE 6
+#define TELEMETRY_IMU_SAMPLE_SIZE 17
+#define TELEMETRY_LIGHT_SIZE 8
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021, start 0xFFFF), bit by bit: frames are short
+static inline uint16_t telemetry_crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static inline uint8_t *telemetry_put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    return out + 2;
+}
+
+static inline uint8_t *telemetry_put_u32(uint8_t *out, uint32_t value)
+{
+    out = telemetry_put_u16(out, (uint16_t)value);
+    return telemetry_put_u16(out, (uint16_t)(value >> 16));
+}
+
+static inline uint16_t telemetry_get_u16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t telemetry_get_u32(const uint8_t *in)
+{
+    return telemetry_get_u16(in) | ((uint32_t)telemetry_get_u16(in + 2) << 16);
+}
+
+#endif
@@ -0,0 +1,216 @@
+// Host replay of recorded IMU traces through the gesture and morse pipeline of the firmware (src/imu_gestures.c).
+// Reports the symbols emitted, the detection against the labels of the trace and the processing time per sample.
+// Build: cmake -S tools/host -B build-host && cmake --build build-host
+// Run:   ./build-host/gesture_replay trace.csv [grace_ms]
+// Test:  ctest --test-dir build-host replays tools/host/traces/labelled_gestures.csv
+// Record a trace with SAMPLE_OUTPUT_TRACE in src/main.c, or decode a telemetry capture with telemetry_decode.
+// The format is in src/imu_trace.h.
+// Exit status: 0 when every labelled gesture was found and nothing else fired, 1 otherwise, 2 on error.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "imu_gestures.h"
+#include "imu_trace.h"
+#include "morse.h"
+
+// A gesture fired this long after the end of its label still counts (hold, window and filter latency)
+#define DEFAULT_GRACE_MS 300
+#define LINE_SIZE 256
+
+struct TraceSample
+{
+    uint32_t timeUs;
+    icm42670_fifo_packet_t packet;
+    char label; // '.', '-', 'S' or 0
+};
+
+// A run of samples with the same label: one gesture expected
+struct LabelSegment
+{
+    size_t first;
+    size_t last;
+    char label;
+    bool found;
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static char gesture_label(const struct GestureRule *gesture)
+{
+    char symbol = imu_gestures_symbol(gesture);
+    return symbol ? symbol : 'S';
+}
+
+// Read the whole trace. Lines that are not a sample or the scale line are skipped.
+static struct TraceSample *read_trace(FILE *file, size_t *count, icm42670_scale_t *scale, unsigned *odrHz)
+{
+    struct TraceSample *samples = NULL;
+    size_t capacity = 0;
+    char line[LINE_SIZE];
+    *count = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned odr, accel, gyro;
+        if (sscanf(line, IMU_TRACE_SCALE_FORMAT, &odr, &accel, &gyro) == 3)
+        {
+            *odrHz = odr;
+            scale->accel_lsb_per_g = (uint16_t)accel;
+            scale->gyro_lsb_per_dps_x10 = (uint16_t)gyro;
+            continue;
+        }
+        unsigned long timeUs;
+        int v[7];
+        int consumed = 0;
+        if (sscanf(line, "%lu,%d,%d,%d,%d,%d,%d,%d,%n", &timeUs, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &consumed) != 8 ||
+            consumed == 0)
+            continue;
+        if (*count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            struct TraceSample *grown = realloc(samples, capacity * sizeof(*samples));
+            if (grown == NULL)
+            {
+                free(samples);
+                return NULL;
+            }
+            samples = grown;
+        }
+        struct TraceSample *sample = &samples[(*count)++];
+        sample->timeUs = (uint32_t)timeUs;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            sample->packet.accel[axis] = (int16_t)v[axis];
+            sample->packet.gyro[axis] = (int16_t)v[3 + axis];
+        }
+        sample->packet.temperature = (int8_t)v[6];
+        sample->packet.timestamp = (uint16_t)timeUs;
+        char label = line[consumed];
+        sample->label = (label == '.' || label == '-' || label == 'S') ? label : 0;
+    }
+    return samples;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s trace.csv [grace_ms]\n", argv[0]);
+        return 2;
+    }
+    unsigned graceMs = argc > 2 ? (unsigned)atoi(argv[2]) : DEFAULT_GRACE_MS;
+    FILE *file = fopen(argv[1], "r");
+    if (file == NULL)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    // Default ranges of the sensor (4 g, 250 dps) if the trace has no scale line
+    icm42670_scale_t scale = {8192, 1310};
+    unsigned odrHz = IMU_GESTURES_ODR_HZ;
+    size_t count;
+    struct TraceSample *samples = read_trace(file, &count, &scale, &odrHz);
+    fclose(file);
+    if (samples == NULL || count == 0)
+    {
+        fprintf(stderr, "%s: no samples\n", argv[1]);
+        free(samples);
+        return 2;
+    }
+    if (odrHz != IMU_GESTURES_ODR_HZ)
+        printf("warning: trace at %u Hz, the gesture table is written for %u Hz\n", odrHz, IMU_GESTURES_ODR_HZ);
+
+    static struct ImuGestures gestures;
+    if (!imu_gestures_init(&gestures, &scale))
+    {
+        fprintf(stderr, "gesture rules could not be compiled\n");
+        free(samples);
+        return 2;
+    }
+
+    // Labelled segments
+    struct LabelSegment *segments = calloc(count, sizeof(*segments));
+    if (segments == NULL)
+    {
+        fprintf(stderr, "out of memory for %zu samples\n", count);
+        free(samples);
+        return 2;
+    }
+    size_t segmentCount = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (samples[i].label == 0)
+            continue;
+        if (segmentCount > 0 && segments[segmentCount - 1].label == samples[i].label && segments[segmentCount - 1].last == i - 1)
+            segments[segmentCount - 1].last = i;
+        else
+            segments[segmentCount++] = (struct LabelSegment){i, i, samples[i].label, false};
+    }
+
+    // Replay like imu_gesture_task: a new reading starts when the time is back to 0
+    struct MorsePacked message = {0};
+    size_t graceSamples = graceMs * odrHz / 1000;
+    size_t emitted = 0, falsePositives = 0, segment = 0;
+    double totalNs = 0, maxNs = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (samples[i].timeUs == 0)
+            imu_gestures_reset(&gestures);
+        double start = now_ns();
+        const struct GestureRule *gesture = imu_gestures_process(&gestures, &samples[i].packet, NULL);
+        double elapsed = now_ns() - start;
+        totalNs += elapsed;
+        if (elapsed > maxNs)
+            maxNs = elapsed;
+        if (gesture == NULL)
+            continue;
+
+        emitted++;
+        char label = gesture_label(gesture);
+        if (label != 'S')
+            morse_packed_append_char(&message, label);
+        // Match with the first open segment this sample is in or just after
+        while (segment < segmentCount && segments[segment].last + graceSamples < i)
+            segment++;
+        bool matched = false;
+        for (size_t s = segment; s < segmentCount && segments[s].first <= i; s++)
+        {
+            if (!segments[s].found && segments[s].label == label)
+            {
+                segments[s].found = true;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched && segmentCount > 0)
+            falsePositives++;
+        printf("%10lu us  %c  %s%s\n", (unsigned long)samples[i].timeUs, label, gesture->name,
+               (!matched && segmentCount > 0) ? "  <- false positive" : "");
+    }
+
+    // Only the symbols: the letter and word gaps come from the light sensor in the firmware, not from the trace
+    char morseText[MORSE_PACKED_TEXT_MAX];
+    morse_packed_to_text(&message, morseText, sizeof(morseText));
+    printf("samples:   %zu (%.1f s)\n", count, (double)count / odrHz);
+    printf("symbols:   %zu, morse \"%s\"\n", emitted, morseText);
+    size_t missed = 0;
+    if (segmentCount > 0)
+    {
+        for (size_t s = 0; s < segmentCount; s++)
+            if (!segments[s].found)
+                missed++;
+        printf("labels:    %zu, found %zu, missed %zu, false positives %zu\n", segmentCount, segmentCount - missed, missed,
+               falsePositives);
+    }
+    printf("time:      %.1f ns/sample mean, %.1f ns max\n", totalNs / count, maxNs);
+
+    free(segments);
+    free(samples);
+    return (missed || falsePositives) ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+// Host checks of the gesture rule compiler (src/gesture.c): the breakpoint table of a channel at and over its limit.
+// Build: cmake -S tools/host -B build-host && cmake --build build-host
+// Run:   ctest --test-dir build-host (or ./build-host/gesture_test)
+// Exit status: 0 when every check passed, 1 otherwise.
+#include <stdio.h>
+#include <string.h>
+
+#include "gesture.h"
+
+static const struct GestureScale testScale = {8192, 655, 2};
+// One sample is enough to fire: the checks are about the tables, not the timing
+static const struct GestureTiming testTiming = {1, 1, 0, 0};
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Rule r with windowCount windows on the roll channel. Window w is (first + 2 * w, first + 2 * w + 1) degrees, so
+// every window adds 2 new bounds unless first repeats.
+static void make_roll_rule(struct GestureRule *rule, uint8_t event, uint8_t windowCount, int16_t first)
+{
+    memset(rule, 0, sizeof(*rule));
+    rule->name = "roll";
+    rule->event = event;
+    rule->hold = 0;
+    rule->windowCount = windowCount;
+    for (uint8_t w = 0; w < windowCount; w++)
+    {
+        rule->windows[w].channel = GESTURE_ROLL;
+        rule->windows[w].min = (int16_t)(first + 2 * w);
+        rule->windows[w].max = (int16_t)(first + 2 * w + 1);
+    }
+}
+
+static const struct GestureRule *evaluate_roll(struct GestureEngine *engine, int16_t rollCentiDeg)
+{
+    struct GestureInput input;
+    memset(&input, 0, sizeof(input));
+    input.roll = rollCentiDeg;
+    gesture_reset(engine);
+    return gesture_evaluate(engine, &input);
+}
+
+int main(void)
+{
+    static struct GestureEngine engine;
+    static struct GestureRule rules[GESTURE_MAX_RULES];
+
+    // Exactly GESTURE_MAX_BREAKPOINTS distinct bounds on one channel: one window per rule
+    for (uint8_t r = 0; r < GESTURE_MAX_RULES; r++)
+        make_roll_rule(&rules[r], (uint8_t)(r + 1), 1, (int16_t)(4 * r));
+    check(gesture_compile(&engine, rules, GESTURE_MAX_RULES, &testScale, &testTiming), "compile at the limit");
+    check(engine.tableCount == 1 && engine.tables[0].breakpointCount == GESTURE_MAX_BREAKPOINTS,
+          "every bound of the full table is kept");
+    // 4r < roll < 4r + 1 degrees is rule r
+    const struct GestureRule *fired = evaluate_roll(&engine, 4 * 5 * 100 + 50);
+    check(fired == &rules[5], "the full table finds the rule of the sample");
+    check(evaluate_roll(&engine, 4 * 5 * 100 + 250) == NULL, "the full table finds no rule between windows");
+
+    // One bound more does not fit
+    make_roll_rule(&rules[GESTURE_MAX_RULES - 1], GESTURE_MAX_RULES, 2, (int16_t)(4 * (GESTURE_MAX_RULES - 1)));
+    rules[GESTURE_MAX_RULES - 1].windows[1].min = 500;
+    rules[GESTURE_MAX_RULES - 1].windows[1].max = GESTURE_OPEN_MAX;
+    check(!gesture_compile(&engine, rules, GESTURE_MAX_RULES, &testScale, &testTiming), "refuse one bound over the limit");
+
+    // Several windows of each rule on the same channel: 4 times the bounds of the table
+    for (uint8_t r = 0; r < GESTURE_MAX_RULES; r++)
+        make_roll_rule(&rules[r], (uint8_t)(r + 1), GESTURE_MAX_WINDOWS, (int16_t)(2 * GESTURE_MAX_WINDOWS * r));
+    check(!gesture_compile(&engine, rules, GESTURE_MAX_RULES, &testScale, &testTiming),
+          "refuse the windows that would overflow the table");
+
+    // The same windows repeated by every rule share their bounds
+    for (uint8_t r = 0; r < GESTURE_MAX_RULES; r++)
+        make_roll_rule(&rules[r], (uint8_t)(r + 1), GESTURE_MAX_WINDOWS, 0);
+    check(gesture_compile(&engine, rules, GESTURE_MAX_RULES, &testScale, &testTiming), "shared bounds are counted once");
+    check(engine.tables[0].breakpointCount == 2 * GESTURE_MAX_WINDOWS, "shared bounds are stored once");
+
+    if (failures == 0)
+        printf("gesture_test: all checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
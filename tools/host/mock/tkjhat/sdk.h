@@ -0,0 +1,24 @@
+// Host stand-in for the TKJHAT sdk: only the IMU types and constants the application pipeline (src/imu_gestures.c)
+// uses. The samples come from a trace file instead of the sensor.
+#ifndef SDK_H
+#define SDK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ICM42670_FIFO_TEMP_LSB_PER_C            2       // FIFO temperature: °C = value / 2 + 25
+
+typedef struct {
+    uint16_t accel_lsb_per_g;         ///< Counts for 1 g (16384, 8192, 4096, 2048)
+    uint16_t gyro_lsb_per_dps_x10;    ///< Counts for 10 dps (1310, 655, 328, 164)
+} icm42670_scale_t;
+
+typedef struct {
+    int16_t accel[3];       ///< X, Y, Z acceleration (raw counts)
+    int16_t gyro[3];        ///< X, Y, Z angular rate (raw counts)
+    int8_t temperature;     ///< Temperature, °C = value / 2 + 25
+    uint16_t timestamp;     ///< Sensor timestamp in µs, wraps every 65.5 ms
+} icm42670_fifo_packet_t;
+
+#endif /* SDK_H */
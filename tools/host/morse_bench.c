@@ -0,0 +1,74 @@
+// Host microbenchmark: morse decode latency per symbol, trie vs the old linear strcmp scan.
+// Build: cmake -S tools/host -B build-host && cmake --build build-host && ./build-host/morse_bench
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "morse.h"
+
+#define MORSE_ALPHABET_SIZE 40
+#define MORSE_CHARACTER_SIZE 7
+#define BENCH_ROUNDS 200000
+
+// Copy of the table and the search that src/main.c used before the trie.
+struct MorseAlphabet
+{
+    char morseCode[MORSE_CHARACTER_SIZE];
+    char letter;
+};
+
+static const struct MorseAlphabet morseCodes[MORSE_ALPHABET_SIZE] = {
+    {".-", 'a'}, {"-...", 'b'}, {"-.-.", 'c'}, {"-..", 'd'}, {".", 'e'}, {"..-.", 'f'}, {"--.", 'g'}, {"....", 'h'}, {"..", 'i'}, {".---", 'j'}, {"-.-", 'k'}, {".-..", 'l'}, {"--", 'm'}, {"-.", 'n'}, {"---", 'o'}, {".--.", 'p'}, {"--.-", 'q'}, {".-.", 'r'}, {"...", 's'}, {"-", 't'}, {"..-", 'u'}, {"...-", 'v'}, {".--", 'w'}, {"-..-", 'x'}, {"-.--", 'y'}, {"--..", 'z'}, {"-----", '0'}, {".----", '1'}, {"..---", '2'}, {"...--", '3'}, {"....-", '4'}, {".....", '5'}, {"-....", '6'}, {"--...", '7'}, {"---..", '8'}, {"----.", '9'}, {".-.-.-", '.'}, {"--..--", ','}, {"..--..", '?'}, {"-.-.--", '!'},
+};
+
+static char linear_find_letter(const char *morseCode)
+{
+    for (int i = 0; i < MORSE_ALPHABET_SIZE; i++)
+    {
+        if (strcmp(morseCode, morseCodes[i].morseCode) == 0)
+        {
+            return morseCodes[i].letter;
+        }
+    }
+    return 'n';
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    size_t lengths[MORSE_ALPHABET_SIZE];
+    int mismatches = 0;
+    for (int i = 0; i < MORSE_ALPHABET_SIZE; i++)
+    {
+        lengths[i] = strlen(morseCodes[i].morseCode);
+        if (morse_decode(morseCodes[i].morseCode, lengths[i]) != morseCodes[i].letter)
+        {
+            printf("mismatch for %s\n", morseCodes[i].morseCode);
+            mismatches++;
+        }
+    }
+
+    // volatile sink so the compiler cannot drop the lookups
+    volatile char sink = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (int i = 0; i < MORSE_ALPHABET_SIZE; i++)
+            sink ^= linear_find_letter(morseCodes[i].morseCode);
+    double linearNs = (now_ns() - start) / ((double)BENCH_ROUNDS * MORSE_ALPHABET_SIZE);
+
+    start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+        for (int i = 0; i < MORSE_ALPHABET_SIZE; i++)
+            sink ^= morse_decode(morseCodes[i].morseCode, lengths[i]);
+    double trieNs = (now_ns() - start) / ((double)BENCH_ROUNDS * MORSE_ALPHABET_SIZE);
+
+    printf("linear strcmp scan: %6.1f ns/symbol\n", linearNs);
+    printf("trie decode:        %6.1f ns/symbol (%.1fx)\n", trieNs, linearNs / trieNs);
+    return mismatches ? 1 : 0;
+}
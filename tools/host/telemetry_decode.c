@@ -0,0 +1,137 @@
+// Host decoder of the binary telemetry of the firmware (src/telemetry_format.h), captured from the usb serial.
+// The IMU samples are written as an IMU trace (src/imu_trace.h) that gesture_replay reads, the light sensor samples
+// as CSV. The text logs between the frames and the frames with a wrong CRC are skipped.
+// Build: cmake -S tools/host -B build-host && cmake --build build-host
+// Run:   ./build-host/telemetry_decode capture.bin [light.csv] > trace.csv
+// Capture for example with: stty -F /dev/ttyACM0 raw && cat /dev/ttyACM0 > capture.bin
+// Exit status: 0 when no frame was lost, 1 when frames were dropped or corrupted, 2 on error.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "imu_trace.h"
+#include "telemetry_format.h"
+
+struct DecodeStats
+{
+    unsigned long frames;
+    unsigned long crcErrors;
+    unsigned long lostFrames;
+    bool hasSequence;
+    uint8_t nextSequence;
+};
+
+// The first bytes of the window can still be the start of a frame
+static bool frame_start(const uint8_t *frame, size_t have)
+{
+    return (have < 1 || frame[0] == TELEMETRY_SYNC0) && (have < 2 || frame[1] == TELEMETRY_SYNC1) &&
+           (have < 4 || frame[3] <= TELEMETRY_MAX_PAYLOAD);
+}
+
+// The window is not a frame: drop bytes up to the next start of a frame in it
+static size_t resync(uint8_t *frame, size_t have)
+{
+    do
+    {
+        size_t next = 1;
+        while (next < have && frame[next] != TELEMETRY_SYNC0)
+            next++;
+        for (size_t i = next; i < have; i++)
+            frame[i - next] = frame[i];
+        have -= next;
+    } while (!frame_start(frame, have));
+    return have;
+}
+
+static void decode_frame(const uint8_t *frame, FILE *trace, FILE *light)
+{
+    uint8_t type = frame[2];
+    uint8_t length = frame[3];
+    const uint8_t *payload = &frame[TELEMETRY_HEADER_SIZE];
+    if (type == TELEMETRY_IMU_SCALE && length == TELEMETRY_IMU_SCALE_SIZE)
+    {
+        fprintf(trace, IMU_TRACE_SCALE_FORMAT IMU_TRACE_COLUMNS, telemetry_get_u16(payload), telemetry_get_u16(payload + 2),
+                telemetry_get_u16(payload + 4));
+    }
+    else if (type == TELEMETRY_IMU_SAMPLE && length == TELEMETRY_IMU_SAMPLE_SIZE)
+    {
+        int16_t v[6];
+        for (int i = 0; i < 6; i++)
+            v[i] = (int16_t)telemetry_get_u16(payload + 4 + 2 * i);
+        fprintf(trace, IMU_TRACE_SAMPLE_FORMAT, (unsigned long)telemetry_get_u32(payload), v[0], v[1], v[2], v[3], v[4], v[5],
+                (int8_t)payload[16]);
+    }
+    else if (type == TELEMETRY_LIGHT && length == TELEMETRY_LIGHT_SIZE && light != NULL)
+    {
+        fprintf(light, "%lu,%lu\n", (unsigned long)telemetry_get_u32(payload), (unsigned long)telemetry_get_u32(payload + 4));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s capture.bin [light.csv] > trace.csv\n", argv[0]);
+        return 2;
+    }
+    FILE *input = fopen(argv[1], "rb");
+    if (input == NULL)
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    FILE *light = NULL;
+    if (argc > 2)
+    {
+        light = fopen(argv[2], "w");
+        if (light == NULL)
+        {
+            perror(argv[2]);
+            fclose(input);
+            return 2;
+        }
+        fprintf(light, "time_ms,lux\n");
+    }
+
+    // Sliding window over the input: look for the sync bytes, then wait for the whole frame
+    struct DecodeStats stats = {0};
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    size_t have = 0;
+    int c;
+    while ((c = fgetc(input)) != EOF)
+    {
+        frame[have++] = (uint8_t)c;
+        // Text logs between the frames
+        if (!frame_start(frame, have))
+        {
+            have = resync(frame, have);
+            continue;
+        }
+        if (have < TELEMETRY_HEADER_SIZE || have < (size_t)TELEMETRY_HEADER_SIZE + frame[3] + TELEMETRY_CRC_SIZE)
+            continue;
+
+        size_t covered = 3 + frame[3];
+        if (telemetry_crc16(&frame[2], covered) != telemetry_get_u16(&frame[2 + covered]))
+        {
+            // Sync bytes inside a text log or a damaged frame: look for the next sync after this one
+            stats.crcErrors++;
+            have = resync(frame, have);
+            continue;
+        }
+        // The sequence counts every frame the firmware built, also the ones it had to drop
+        uint8_t sequence = frame[4];
+        if (stats.hasSequence && sequence != stats.nextSequence)
+            stats.lostFrames += (uint8_t)(sequence - stats.nextSequence);
+        stats.hasSequence = true;
+        stats.nextSequence = (uint8_t)(sequence + 1);
+        stats.frames++;
+        decode_frame(frame, stdout, light);
+        have = 0;
+    }
+    fclose(input);
+    if (light != NULL)
+        fclose(light);
+
+    fprintf(stderr, "frames: %lu, lost %lu, bad %lu\n", stats.frames, stats.lostFrames, stats.crcErrors);
+    return (stats.lostFrames || stats.crcErrors) ? 1 : 0;
+}